@@ -16,13 +16,17 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+
 #include <vector>
 #include <string>
 #include <utility>
 #include <iostream>
 #include <algorithm>
-#include <unordered_map>
 #include <memory>
+#include <deque>
+#include <future>
+#include <thread>
+#include <fstream>
 
 #include <paint/paint.h>
 #include <paint/canvas.h>
@@ -32,214 +36,328 @@
 
 #include <libbmp.h>
 
-using util::from_string;
-using util::limit_range;
+#include "input.h"
+#include "script.h"
+#include "session.h"
+
+using Script::Opcode;
+using Script::Command;
+using Script::Program;
 
-extern bool mathcoord;
+Session::Session(bool mathcoord, std::ostream& err, const std::string& name) :
+    mathcoord(mathcoord), err(err), name(name)
+{ }
 
-static Paint::Canvas<LibBmp::BmpDevice> canvas;
-static Paint::RGBColor forecolor;
+std::ostream& Session::report() {
+    if (!name.empty()) err << name << ": ";
+    return err;
+}
 
-static inline float read_x(std::string str) { return from_string<float>(str); }
-static inline float read_y(std::string str) {
-    float val = from_string<float>(str);
+inline float Session::read_y(float val) {
     if (mathcoord) val = canvas.getHeight() - val;
     return val;
 }
 
+template <typename PointT>
+std::vector<PointT> Session::read_points(const Command& cmd, const Program& prog) {
+    std::vector<PointT> points;
+    points.reserve(cmd.count);
+    for (uint32_t i = cmd.first; i < cmd.first + cmd.count; i++)
+        points.emplace_back(prog.points[i].x, read_y(prog.points[i].y));
+    return points;
+}
 
-static const std::unordered_map<std::string, 
-        Paint::Line::Algorithm> ldalg {
-    { "DDA",            Paint::Line::Algorithm::DDA            },
-    { "Bresenham",      Paint::Line::Algorithm::Bresenham      },
-};
-static const std::unordered_map<std::string,
-    Paint::LineClippingAlgorithm> clipalg {
-    { "Cohen-Sutherland",   Paint::LineClippingAlgorithm::CohenSutherland   },
-    { "Liang-Barsky",       Paint::LineClippingAlgorithm::LiangBarsky       },
-};
-
-
-static int line = 0;
-
-static bool batch_readline(std::string& str) {
-    if (std::getline(std::cin, str).fail()) return false;
-    size_t pos = str.find('#');
-    if (pos != std::string::npos) str.resize(pos);
-    line++;
-    return true;
+// Applies the current drawing state to a new primitive.
+template <typename T>
+T* Session::styled(T *prim) {
+    prim->set_antialias(antialias);
+    prim->set_stroke_width(stroke_width);
+    return prim;
 }
 
-using CommandHandler = void (*)(std::vector<std::string>& args);
+void Session::error(const Command& cmd, const Program& prog) {
+    throw std::invalid_argument(prog.strings[cmd.first]);
+}
 
-static void resetCanvas(std::vector<std::string>& args) {
-    if (args.size() != 3) 
-        throw std::invalid_argument("invalid argument number");
-    size_t width = limit_range<size_t>(from_string(args[1]), 
-                    0, Paint::MAX_COORDINATE),
-           height = limit_range<size_t>(from_string(args[2]),
-                    0, Paint::MAX_COORDINATE);
-    canvas.reset(width, height);
+void Session::resetCanvas(const Command& cmd, const Program& prog) {
+    canvas.reset(cmd.arg[0], cmd.arg[1]);
     canvas.primitives.clear();
+    canvas.shapes.clear();
 }
 
-static void resize(std::vector<std::string>& args) {
-    if (args.size() != 3)
-        throw std::invalid_argument("invalid argument number");
-    size_t width = limit_range<size_t>(from_string(args[1]),
-                                       0, Paint::MAX_COORDINATE),
-        height = limit_range<size_t>(from_string(args[2]),
-                                     0, Paint::MAX_COORDINATE);
-    canvas.reset(width, height);
+void Session::resize(const Command& cmd, const Program& prog) {
+    canvas.reset(cmd.arg[0], cmd.arg[1]);
 }
 
-static void saveCanvas(std::vector<std::string>& args) {
-    if (args.size() != 2)
-        throw std::invalid_argument("invalid argument number");
+void Session::saveCanvas(const Command& cmd, const Program& prog) {
     canvas.clear(Paint::Colors::white);
     canvas.paint();
-    canvas.save(args[1]);
-}
-
-static void setColor(std::vector<std::string>& args) {
-    if (args.size() != 4)
-        throw std::invalid_argument("invalid argument number");
-    uint8_t red = limit_range<uint8_t>(from_string(args[1])),
-            green = limit_range<uint8_t>(from_string(args[2])),
-            blue = limit_range<uint8_t>(from_string(args[3]));
-    forecolor = Paint::RGBColor(red, green, blue);
-}
-
-static void drawLine(std::vector<std::string>& args) {
-    if (args.size() != 7) 
-        throw std::invalid_argument("invalid argument number");
-    int id = from_string(args[1]);
-    float x1 = read_x(args[2]), y1 = read_y(args[3]),
-          x2 = read_x(args[4]), y2 = read_y(args[5]);
-    if (!canvas.primitives.emplace(id,
-            new Paint::Line(Paint::PointF(x1, y1), Paint::PointF(x2, y2),
-                forecolor, ldalg.at(args[6]))).second)
+    canvas.save(prog.strings[cmd.first]);
+}
+
+void Session::setColor(const Command& cmd, const Program& prog) {
+    forecolor = Paint::RGBColor(cmd.arg[0], cmd.arg[1], cmd.arg[2]);
+}
+
+void Session::setAntialias(const Command& cmd, const Program& prog) {
+    antialias = cmd.arg[0] != 0;
+}
+
+void Session::setWidth(const Command& cmd, const Program& prog) {
+    stroke_width = cmd.arg[0];
+}
+
+void Session::drawLine(const Command& cmd, const Program& prog) {
+    float x1 = cmd.arg[0], y1 = read_y(cmd.arg[1]),
+          x2 = cmd.arg[2], y2 = read_y(cmd.arg[3]);
+    if (!canvas.primitives.emplace(cmd.id,
+            styled(new Paint::Line(Paint::PointF(x1, y1), Paint::PointF(x2, y2),
+                forecolor, Paint::Line::Algorithm(cmd.algo)))).second)
         throw std::invalid_argument(
-            "id " + std::to_string(id) + " already exists");
-}
-
-static void drawPolygon(std::vector<std::string>& args) {
-    if (args.size() != 4) 
-        throw std::invalid_argument("invalid argument number");
-    int id = from_string(args[1]);
-    size_t nr_point = 
-        limit_range<size_t>(from_string(args[2]), 2, 1000000);
-    std::string str;
-    Paint::Line::Algorithm algo = ldalg.at(args[3]);
-    if (!batch_readline(str))
-        throw std::invalid_argument("points of polygon expected");
-    std::vector<std::string> points_str = util::split(str);
-    if (points_str.size() != nr_point * 2)
-        throw std::invalid_argument("invalid number of coordinates");
-    std::vector<std::pair<float, float>> points;
-    for (size_t i = 0; i < nr_point; i++) 
-        points.emplace_back(read_x(points_str[i*2]),
-                            read_y(points_str[i*2+1]));
-    if (canvas.add_primitive(new Paint::Polygon(points, forecolor, algo), id) < 0)
-        throw std::invalid_argument("id " + std::to_string(id) + " already exists");
-}
-
-static void drawEllipse(std::vector<std::string>& args) {
-    if (args.size() != 6) 
-        throw std::invalid_argument("invalid argument number");
-    int id = from_string(args[1]);
-    float x = read_x(args[2]), y = read_y(args[3]),
-          rx = from_string<float>(args[4]), ry = from_string<float>(args[5]);
-    if (canvas.add_primitive(new Paint::Ellipse(x, y, rx, ry, forecolor), id) < 0)
-        throw std::invalid_argument("id " + std::to_string(id) + " already exists");
-}
-
-static void drawCurve(std::vector<std::string>& args) {
-    if (args.size() != 4)
-        throw std::invalid_argument("invalid argument number");
-    int id = from_string(args[1]);
-    size_t nr_point =
-        limit_range<size_t>(from_string(args[2]), 2, 1000000);
-    std::string str;
-    // Paint::LineDrawingAlgorithm algo = ldalg.at(args[3]);
-    if (!batch_readline(str))
-        throw std::invalid_argument("points of curve expected");
-    std::vector<std::string> points_str = util::split(str);
-    if (points_str.size() != nr_point * 2)
-        throw std::invalid_argument("invalid number of coordinates");
+            "id " + std::to_string(cmd.id) + " already exists");
+}
+
+void Session::drawPolygon(const Command& cmd, const Program& prog) {
+    std::vector<std::pair<float, float>> points =
+        read_points<std::pair<float, float>>(cmd, prog);
+    if (canvas.add_primitive(styled(new Paint::Polygon(points, forecolor,
+            Paint::Line::Algorithm(cmd.algo))), cmd.id) < 0)
+        throw std::invalid_argument("id " + std::to_string(cmd.id) + " already exists");
+}
+
+void Session::drawEllipse(const Command& cmd, const Program& prog) {
+    float x = cmd.arg[0], y = read_y(cmd.arg[1]),
+          rx = cmd.arg[2], ry = cmd.arg[3];
+    if (canvas.add_primitive(styled(new Paint::Ellipse(x, y, rx, ry, forecolor)), cmd.id) < 0)
+        throw std::invalid_argument("id " + std::to_string(cmd.id) + " already exists");
+}
+
+void Session::drawCurve(const Command& cmd, const Program& prog) {
+    std::vector<Paint::PointF> points = read_points<Paint::PointF>(cmd, prog);
+    switch (Paint::CurveDrawingAlgorithm(cmd.algo)) {
+    case Paint::CurveDrawingAlgorithm::BSpline:
+        if (canvas.add_primitive(styled(new Paint::BSpline(points, forecolor)), cmd.id) < 0)
+            throw std::invalid_argument("id " + std::to_string(cmd.id) + " already exists");
+        break;
+    case Paint::CurveDrawingAlgorithm::Bezier:
+        if (canvas.add_primitive(styled(new Paint::Bezier(points, forecolor)), cmd.id) < 0)
+            throw std::invalid_argument("id " + std::to_string(cmd.id) + " already exists");
+        break;
+    case Paint::CurveDrawingAlgorithm::CubicBezier:
+        if (canvas.add_primitive(styled(new Paint::Bezier(points, forecolor, true)), cmd.id) < 0)
+            throw std::invalid_argument("id " + std::to_string(cmd.id) + " already exists");
+        break;
+    }
+}
+
+void Session::fill(const Command& cmd, const Program& prog) {
+    Paint::PointF seed(cmd.arg[0], read_y(cmd.arg[1]));
+    if (canvas.add_primitive(new Paint::Fill(seed, forecolor), cmd.id) < 0)
+        throw std::invalid_argument("id " + std::to_string(cmd.id) + " already exists");
+}
+
+// Shape points are relative to the position of each instance, so only
+// their direction is flipped in mathematical coordinates.
+void Session::defineShape(const Command& cmd, const Program& prog) {
     std::vector<Paint::PointF> points;
-    for (size_t i = 0; i < nr_point; i++)
-        points.emplace_back(read_x(points_str[i*2]),
-                            read_y(points_str[i*2+1]));
-    if (args[3] == "BSpline") {
-        if (canvas.add_primitive(new Paint::BSpline(points, forecolor), id) < 0)
-            throw std::invalid_argument("id " + std::to_string(id) + " already exists");
-    } else if (args[3] == "Bezier") {
-        if (canvas.add_primitive(new Paint::BSpline(points, forecolor), id) < 0)
-            throw std::invalid_argument("id " + std::to_string(id) + " already exists");
-    } else throw std::invalid_argument("unrecognized curve type");
-}
-
-static void translate(std::vector<std::string>& args) {
-    if (args.size() != 4) 
-        throw std::invalid_argument("invalid argument number");
-    int id = from_string(args[1]);
-    float dx = from_string<float>(args[2]), dy = -from_string<float>(args[3]);
-    canvas[id].translate(dx, dy);
-}
-
-static void rotate(std::vector<std::string>& args) {
-    if (args.size() != 5) 
-        throw std::invalid_argument("invalid argument number");
-    int id = from_string(args[1]);
-    float cx = read_x(args[2]), cy = read_y(args[3]);
-    float rdeg = from_string<float>(args[4]);
-    canvas[id].rotate(cx, cy, rdeg);
-}
-
-static void scale(std::vector<std::string>& args) {
-    if (args.size() != 5)
-        throw std::invalid_argument("invalid argument number");
-    int id = from_string(args[1]);
-    float cx = read_x(args[2]), cy = read_y(args[3]);
-    float s = from_string<float>(args[4]);
-    canvas[id].scale(cx, cy, s);
-}
-
-static void clip(std::vector<std::string>& args) {
-    if (args.size() != 7)
-        throw std::invalid_argument("invalid argument number");
-    int id = from_string(args[1]);
-    float x1 = read_x(args[2]), y1 = read_y(args[3]);
-    float x2 = read_x(args[4]), y2 = read_y(args[5]);
-    Paint::LineClippingAlgorithm algo = clipalg.at(args[6]);
-    dynamic_cast<Paint::Line&>(canvas[id]).clip(x1, y1, x2, y2, algo);
-}
-
-static const std::unordered_map<std::string, CommandHandler> handler {
-    { "resetCanvas",    resetCanvas     },
-    { "resize",         resize          },
-    { "saveCanvas",     saveCanvas      },
-    { "setColor",       setColor        },
-    { "drawLine",       drawLine        },
-    { "drawPolygon",    drawPolygon     },
-    { "drawEllipse",    drawEllipse     },
-    { "drawCurve",      drawCurve       },
-    { "translate",      translate       },
-    { "rotate",         rotate          },
-    { "scale",          scale           },
-    { "clip",           clip            },
+    points.reserve(cmd.count);
+    for (uint32_t i = cmd.first; i < cmd.first + cmd.count; i++)
+        points.emplace_back(prog.points[i].x,
+                            mathcoord ? -prog.points[i].y : prog.points[i].y);
+    Paint::Primitive *prototype;
+    if (cmd.arg[0] == 0) {
+        std::vector<std::pair<float, float>> pts;
+        pts.reserve(points.size());
+        for (auto& p : points) pts.emplace_back(p.x, p.y);
+        prototype = new Paint::Polygon(std::move(pts), forecolor,
+                                       Paint::Line::Algorithm(cmd.algo));
+    } else if (Paint::CurveDrawingAlgorithm(cmd.algo) == Paint::CurveDrawingAlgorithm::BSpline) {
+        prototype = new Paint::BSpline(std::move(points), forecolor);
+    } else {
+        prototype = new Paint::Bezier(std::move(points), forecolor,
+            Paint::CurveDrawingAlgorithm(cmd.algo) == Paint::CurveDrawingAlgorithm::CubicBezier);
+    }
+    if (!canvas.add_shape(prototype, cmd.id))
+        throw std::invalid_argument("shape " + std::to_string(cmd.id) + " already exists");
+}
+
+void Session::instantiate(const Command& cmd, const Program& prog) {
+    int sid = cmd.arg[0];
+    auto shape = canvas.shapes.find(sid);
+    if (shape == canvas.shapes.end())
+        throw std::invalid_argument("shape " + std::to_string(sid) + " does not exist");
+    Paint::PointF offset(cmd.arg[1], read_y(cmd.arg[2]));
+    if (canvas.add_primitive(styled(new Paint::Instance(shape->second, forecolor, offset)),
+                             cmd.id) < 0)
+        throw std::invalid_argument("id " + std::to_string(cmd.id) + " already exists");
+}
+
+// Translated primitives keep their raster, since they are likely to be
+// moved again.
+void Session::translate(const Command& cmd, const Program& prog) {
+    canvas[cmd.id].set_raster_cache(true);
+    canvas[cmd.id].translate(cmd.arg[0], cmd.arg[1]);
+}
+
+void Session::rotate(const Command& cmd, const Program& prog) {
+    canvas[cmd.id].rotate(cmd.arg[0], read_y(cmd.arg[1]), cmd.arg[2]);
+}
+
+void Session::scale(const Command& cmd, const Program& prog) {
+    canvas[cmd.id].scale(cmd.arg[0], read_y(cmd.arg[1]), cmd.arg[2]);
+}
+
+void Session::clip(const Command& cmd, const Program& prog) {
+    float x1 = cmd.arg[0], y1 = read_y(cmd.arg[1]);
+    float x2 = cmd.arg[2], y2 = read_y(cmd.arg[3]);
+    dynamic_cast<Paint::Line&>(canvas[cmd.id]).clip(x1, y1, x2, y2,
+        Paint::LineClippingAlgorithm(cmd.algo));
+}
+
+void Session::saveSnapshot(const Command& cmd, const Program& prog) {
+    canvas.save_snapshot(prog.strings[cmd.first]);
+}
+
+void Session::loadSnapshot(const Command& cmd, const Program& prog) {
+    canvas.load_snapshot(prog.strings[cmd.first]);
+}
+
+const Session::Handler Session::handler[] {
+    &Session::error,
+    &Session::resetCanvas,
+    &Session::resize,
+    &Session::saveCanvas,
+    &Session::setColor,
+    &Session::drawLine,
+    &Session::drawPolygon,
+    &Session::drawEllipse,
+    &Session::drawCurve,
+    &Session::translate,
+    &Session::rotate,
+    &Session::scale,
+    &Session::clip,
+    &Session::saveSnapshot,
+    &Session::loadSnapshot,
+    &Session::setAntialias,
+    &Session::setWidth,
+    &Session::fill,
+    &Session::defineShape,
+    &Session::instantiate,
 };
 
-void batch() {
-    std::string command;
-    while (batch_readline(command)) {
-        std::vector<std::string> tokens = util::split(command);
-        if (tokens.empty()) continue;
+void Session::execute(const Program& prog) {
+    for (const Command& cmd : prog.commands) {
         try {
-            handler.at(tokens.front())(tokens); 
+            (this->*handler[static_cast<int>(cmd.op)])(cmd, prog);
         } catch (const std::exception& ex) {
-            std::cerr << "line " << line << ": " << ex.what() << std::endl;
+            report() << "line " << cmd.line << ": " << ex.what() << std::endl;
+        }
+    }
+}
+
+// Scripts are cut into chunks of roughly this size at line boundaries and
+// parsed concurrently; the parsed chunks are executed in input order.
+static constexpr size_t CHUNK_SIZE = 1 << 18;
+
+struct Chunk {
+    // Mapped input is referred to in place; otherwise the lines are copied.
+    const char *begin = nullptr, *end = nullptr;
+    std::string text;
+    int first_line;
+};
+
+static bool read_chunk(BatchInput& in, int& line, Chunk& chunk) {
+    const char *begin, *end;
+    size_t size = 0;
+    bool tail = false;
+    chunk.first_line = line + 1;
+    while ((size < CHUNK_SIZE || tail) && in.readline(begin, end)) {
+        line++;
+        if (in.mapped()) {
+            if (!chunk.begin) chunk.begin = begin;
+            chunk.end = end;
+        } else {
+            chunk.text.append(begin, end);
+            chunk.text.push_back('\n');
         }
+        size += end - begin + 1;
+        tail = Script::takes_next_line(begin, end);
     }
+    return size > 0;
+}
+
+static Program parse_chunk(Chunk chunk) {
+    if (!chunk.begin) {
+        chunk.begin = chunk.text.data();
+        chunk.end = chunk.begin + chunk.text.size();
+    }
+    return Script::parse(chunk.begin, chunk.end, chunk.first_line);
+}
+
+// Parses the text script on fd and hands each parsed chunk to sink in order.
+// Chunks are parsed on threads of their own if parallel is set.
+template <typename SinkT>
+static void parse_text(BatchInput& in, bool parallel, SinkT&& sink) {
+    int line = 0;
+    if (!parallel) {
+        for (;;) {
+            Chunk chunk;
+            if (!read_chunk(in, line, chunk)) return;
+            sink(parse_chunk(std::move(chunk)));
+        }
+    }
+    size_t max_inflight = 2 * std::max(1u, std::thread::hardware_concurrency());
+    std::deque<std::future<Program>> inflight;
+    bool more = true;
+    while (more || !inflight.empty()) {
+        while (more && inflight.size() < max_inflight) {
+            Chunk chunk;
+            more = read_chunk(in, line, chunk);
+            if (more)
+                inflight.push_back(std::async(std::launch::async,
+                    parse_chunk, std::move(chunk)));
+        }
+        if (inflight.empty()) break;
+        sink(inflight.front().get());
+        inflight.pop_front();
+    }
+}
+
+// Number of binary records executed at a time.
+static constexpr size_t BINARY_BATCH = 1 << 16;
+
+void Session::run(int fd) {
+    BatchInput in(fd);
+    Program prog;
+    try {
+        if (Script::read_binary_header(in)) {
+            while (Script::read_binary(in, prog, BINARY_BATCH)) {
+                execute(prog);
+                prog = Program();
+            }
+            return;
+        }
+    } catch (const std::runtime_error& ex) {
+        // The records before a malformed one still run.
+        execute(prog);
+        report() << ex.what() << std::endl;
+        return;
+    }
+    parse_text(in, parallel_parse, [this] (const Program& prog) { execute(prog); });
+}
+
+void convert(int fd, const char *filename) {
+    BatchInput in(fd);
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open())
+        throw std::runtime_error("cannot open '" + std::string(filename) + "'");
+    std::string buf;
+    Script::write_binary_header(buf);
+    parse_text(in, true, [&] (const Program& prog) {
+        Script::write_binary(buf, prog);
+        out.write(buf.data(), buf.size());
+        buf.clear();
+    });
+    if (!out.flush())
+        throw std::runtime_error("cannot write to '" + std::string(filename) + "'");
 }
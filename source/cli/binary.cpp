@@ -0,0 +1,231 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+#include <paint/paint.h>
+#include <paint/primitive.h>
+
+#include "script.h"
+
+using Script::Opcode;
+using Script::Command;
+using Script::Program;
+
+static constexpr size_t RECORD_SIZE = 32;
+static constexpr uint32_t MAX_POINTS = 1000000;
+
+static inline void put_u32(char *buf, uint32_t val) {
+    for (int i = 0; i < 4; i++) buf[i] = char(val >> (8 * i));
+}
+
+static inline uint32_t get_u32(const char *buf) {
+    uint32_t val = 0;
+    for (int i = 0; i < 4; i++) val |= uint32_t(uint8_t(buf[i])) << (8 * i);
+    return val;
+}
+
+static inline void put_f32(char *buf, float val) {
+    uint32_t bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    put_u32(buf, bits);
+}
+
+static inline float get_f32(const char *buf) {
+    uint32_t bits = get_u32(buf);
+    float val;
+    std::memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+static inline size_t padded(size_t len) { return (len + 3) & ~size_t(3); }
+
+static bool has_points(Opcode op) {
+    return op == Opcode::DrawPolygon || op == Opcode::DrawCurve ||
+           op == Opcode::DefineShape;
+}
+
+static bool has_string(Opcode op) {
+    return op == Opcode::SaveCanvas || op == Opcode::SaveSnapshot ||
+           op == Opcode::LoadSnapshot || op == Opcode::Error;
+}
+
+[[noreturn]] static void malformed(const char *what) {
+    throw std::runtime_error(std::string("malformed binary script: ") + what);
+}
+
+// Rejects records the text parser could never have produced.
+static void validate(const Command& cmd) {
+    switch (cmd.op) {
+    case Opcode::ResetCanvas:
+    case Opcode::Resize:
+        for (int i = 0; i < 2; i++)
+            if (!(cmd.arg[i] >= 0 && cmd.arg[i] <= Paint::MAX_COORDINATE))
+                malformed("canvas size out of range");
+        break;
+    case Opcode::SetColor:
+        for (int i = 0; i < 3; i++)
+            if (!(cmd.arg[i] >= 0 && cmd.arg[i] <= 255))
+                malformed("color out of range");
+        break;
+    case Opcode::SetAntialias:
+        if (cmd.arg[0] != 0 && cmd.arg[0] != 1)
+            malformed("invalid anti-aliasing mode");
+        break;
+    case Opcode::SetWidth:
+        if (!(cmd.arg[0] >= 1 && cmd.arg[0] <= Paint::MAX_STROKE_WIDTH))
+            malformed("stroke width out of range");
+        break;
+    case Opcode::DrawLine:
+    case Opcode::DrawPolygon:
+        if (cmd.algo > static_cast<uint8_t>(Paint::Line::Algorithm::FixedDDA))
+            malformed("unknown line algorithm");
+        break;
+    case Opcode::DrawCurve:
+        if (cmd.algo > static_cast<uint8_t>(Paint::CurveDrawingAlgorithm::CubicBezier))
+            malformed("unknown curve type");
+        break;
+    case Opcode::DefineShape:
+        if (cmd.arg[0] == 0) {
+            if (cmd.algo > static_cast<uint8_t>(Paint::Line::Algorithm::FixedDDA))
+                malformed("unknown line algorithm");
+        } else if (cmd.arg[0] == 1) {
+            if (cmd.algo > static_cast<uint8_t>(Paint::CurveDrawingAlgorithm::CubicBezier))
+                malformed("unknown curve type");
+        } else malformed("unknown shape kind");
+        break;
+    case Opcode::Instantiate:
+        if (!(cmd.arg[0] >= 0 && cmd.arg[0] <= Script::MAX_SHAPE_ID) ||
+            cmd.arg[0] != int(cmd.arg[0]))
+            malformed("shape id out of range");
+        break;
+    case Opcode::Clip:
+        if (cmd.algo > static_cast<uint8_t>(Paint::LineClippingAlgorithm::LiangBarsky))
+            malformed("unknown clipping algorithm");
+        break;
+    default:
+        break;
+    }
+    if (has_points(cmd.op) && (cmd.count < 2 || cmd.count > MAX_POINTS))
+        malformed("invalid number of points");
+    if (has_string(cmd.op) && cmd.count > MAX_POINTS)
+        malformed("string too long");
+}
+
+// Reads the rest of the record rec and its payload into cmd and prog.
+static void read_record(BatchInput& in, const char *rec, Command& cmd, Program& prog) {
+    if (uint8_t(rec[0]) > uint8_t(Opcode::Instantiate))
+        malformed("unknown opcode");
+    cmd.op = Opcode(rec[0]);
+    cmd.algo = uint8_t(rec[1]);
+    cmd.id = int32_t(get_u32(rec + 8));
+    for (int i = 0; i < 4; i++)
+        cmd.arg[i] = get_f32(rec + 12 + 4 * i);
+    cmd.count = get_u32(rec + 28);
+    validate(cmd);
+    if (has_points(cmd.op)) {
+        const char *buf = in.fetch(size_t(cmd.count) * 8);
+        if (!buf) malformed("truncated point list");
+        cmd.first = prog.points.size();
+        for (uint32_t i = 0; i < cmd.count; i++)
+            prog.points.emplace_back(get_f32(buf + 8 * i),
+                                     get_f32(buf + 8 * i + 4));
+    } else if (has_string(cmd.op)) {
+        const char *buf = in.fetch(padded(cmd.count));
+        if (!buf) malformed("truncated string");
+        cmd.first = prog.strings.size();
+        prog.strings.emplace_back(buf, cmd.count);
+        cmd.count = 1;
+    } else {
+        cmd.count = 0;
+    }
+}
+
+namespace Script {
+
+    const char BINARY_MAGIC[8] = { 'P', 'A', 'I', 'N', 'T', 'B', 'I', 'N' };
+
+    void write_binary_header(std::string& out) {
+        char buf[16] = {};
+        std::memcpy(buf, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        put_u32(buf + 8, BINARY_VERSION);
+        out.append(buf, sizeof(buf));
+    }
+
+    void write_binary(std::string& out, const Program& prog) {
+        for (const Command& cmd : prog.commands) {
+            char rec[RECORD_SIZE] = {};
+            rec[0] = char(cmd.op);
+            rec[1] = char(cmd.algo);
+            put_u32(rec + 4, cmd.line);
+            put_u32(rec + 8, cmd.id);
+            for (int i = 0; i < 4; i++)
+                put_f32(rec + 12 + 4 * i, cmd.arg[i]);
+            if (has_points(cmd.op)) {
+                put_u32(rec + 28, cmd.count);
+                out.append(rec, sizeof(rec));
+                for (uint32_t i = cmd.first; i < cmd.first + cmd.count; i++) {
+                    char pt[8];
+                    put_f32(pt, prog.points[i].x);
+                    put_f32(pt + 4, prog.points[i].y);
+                    out.append(pt, sizeof(pt));
+                }
+            } else if (has_string(cmd.op)) {
+                const std::string& str = prog.strings[cmd.first];
+                put_u32(rec + 28, str.size());
+                out.append(rec, sizeof(rec));
+                out.append(str);
+                out.append(padded(str.size()) - str.size(), '\0');
+            } else {
+                out.append(rec, sizeof(rec));
+            }
+        }
+    }
+
+    bool read_binary_header(BatchInput& in) {
+        const char *buf = in.peek(16);
+        if (!buf || std::memcmp(buf, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0)
+            return false;
+        if (get_u32(buf + 8) != BINARY_VERSION)
+            malformed("unsupported version");
+        in.fetch(16);
+        return true;
+    }
+
+    bool read_binary(BatchInput& in, Program& prog, size_t max_commands) {
+        while (prog.commands.size() < max_commands) {
+            const char *rec = in.fetch(RECORD_SIZE);
+            if (!rec) {
+                if (in.peek(1)) malformed("truncated record");
+                break;
+            }
+            Command cmd = {};
+            cmd.line = int32_t(get_u32(rec + 4));
+            try {
+                read_record(in, rec, cmd, prog);
+            } catch (const std::runtime_error& ex) {
+                throw std::runtime_error("line " + std::to_string(cmd.line) + ": " + ex.what());
+            }
+            prog.commands.push_back(cmd);
+        }
+        return !prog.commands.empty();
+    }
+}
@@ -0,0 +1,105 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "input.h"
+
+static constexpr size_t BUFFER_CHUNK = 1 << 16;
+
+BatchInput::BatchInput(int fd) : fd(fd) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            mapping = addr;
+            data = static_cast<const char*>(addr);
+            size = st.st_size;
+            eof = true;
+        }
+    }
+}
+
+BatchInput::~BatchInput() {
+    if (mapping) munmap(mapping, size);
+}
+
+// Moves the unread tail to the front of the buffer and appends another
+// chunk from the descriptor. Returns false once nothing more can be read.
+bool BatchInput::fill() {
+    if (eof) return false;
+    size_t remain = size - pos;
+    if (pos && remain) std::memmove(buffer.data(), buffer.data() + pos, remain);
+    if (buffer.size() < remain + BUFFER_CHUNK)
+        buffer.resize(std::max(remain + BUFFER_CHUNK, 2 * buffer.size()));
+    ssize_t nread;
+    do {
+        nread = read(fd, buffer.data() + remain, buffer.size() - remain);
+    } while (nread < 0 && errno == EINTR);
+    data = buffer.data();
+    size = remain;
+    pos = 0;
+    if (nread <= 0) {
+        eof = true;
+        return false;
+    }
+    size += nread;
+    return true;
+}
+
+bool BatchInput::readline(const char *&begin, const char *&end) {
+    for (;;) {
+        if (pos < size) {
+            const char *first = data + pos, *last = data + size;
+            const char *newline = static_cast<const char*>(
+                std::memchr(first, '\n', last - first));
+            if (newline) {
+                begin = first;
+                end = newline;
+                pos = newline - data + 1;
+                return true;
+            }
+        }
+        if (!fill()) break;
+    }
+    if (pos == size) return false;
+    begin = data + pos;
+    end = data + size;
+    pos = size;
+    return true;
+}
+
+const char *BatchInput::peek(size_t n) {
+    while (size - pos < n)
+        if (!fill()) return nullptr;
+    return data + pos;
+}
+
+const char *BatchInput::fetch(size_t n) {
+    const char *ret = peek(n);
+    if (ret) pos += n;
+    return ret;
+}
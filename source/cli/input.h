@@ -0,0 +1,62 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __CLI_INPUT_H__
+#define __CLI_INPUT_H__
+
+#include <cstddef>
+#include <vector>
+
+// Line reader for batch scripts. Regular files are memory-mapped and lines
+// are handed out in place; pipes and terminals fall back to buffered reads.
+class BatchInput {
+public:
+    explicit BatchInput(int fd);
+    ~BatchInput();
+
+    BatchInput(const BatchInput& other) = delete;
+    BatchInput& operator = (const BatchInput& other) = delete;
+
+    // Yields the next line as [begin, end) without the trailing newline.
+    // The range stays valid until the next call.
+    bool readline(const char *&begin, const char *&end);
+
+    // Returns a pointer to the next n bytes without consuming them, or
+    // nullptr if the input ends before that. Valid until the next call.
+    const char *peek(size_t n);
+
+    // Like peek(), but consumes the bytes.
+    const char *fetch(size_t n);
+
+    // Whether lines are handed out from a mapping of the whole file, in
+    // which case they stay valid for the lifetime of this object.
+    bool mapped() const { return mapping != nullptr; }
+
+private:
+    bool fill();
+
+    int fd;
+    bool eof = false;
+    void *mapping = nullptr;
+    const char *data = nullptr;
+    size_t size = 0, pos = 0;
+    std::vector<char> buffer;
+};
+
+#endif
@@ -19,50 +19,153 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
-static bool opened = false;
-bool mathcoord = false;
-void batch();
+#include "session.h"
+
+static std::vector<const char *> inputs;
+// Inputs as paths relative to the output directory.
+static std::vector<std::string> paths;
+static const char *convert_to = nullptr;
+static const char *output_dir = nullptr;
+static bool mathcoord = false;
+static unsigned jobs = 1;
 
 [[noreturn]] void usage(const char *prog) {
     std::fprintf(stderr,
-        "Usage: %s [ -i ] [ input [ output_dir ] ]\n"
+        "Usage: %s [ -i ] [ -j jobs ] [ -c binary ] [ -o output_dir ] [ input... ]\n"
+        "       %s [ -i ] [ -c binary ] input output_dir\n"
         "\n"
         "-i\tUse mathematical coordinate system.\n"
-        "input\tThe input file. If omitted, read from stdin.\n"
-        "output_dir\tThe output directory. If omitted, output to current working directory.\n",
-        prog);
+        "-j jobs\tRun up to jobs input scripts at once.\n"
+        "-c binary\tConvert the input script to binary form instead of running it.\n"
+        "-o output_dir\tThe output directory. If omitted, output to current working directory.\n"
+        "input\tThe input files. If omitted, read from stdin.\n",
+        prog, prog);
     exit(EXIT_FAILURE);
 }
 
+static bool is_directory(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Every argument is an input, except that the second of two names the
+// output directory if it is one and -o and -j are not given, as it did
+// before there were several inputs.
 void parsearg(int argc, char *argv[]) {
+    bool jobs_given = false;
     for (int i = 1; i < argc; i++) {
         if (argv[i][0] == '-') {
             if (std::strcmp(argv[i], "-i") == 0) {
                 mathcoord = true;
+            } else if (std::strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+                convert_to = argv[++i];
+            } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                output_dir = argv[++i];
+            } else if (std::strncmp(argv[i], "-j", 2) == 0) {
+                const char *arg = argv[i][2] ? argv[i] + 2 : i + 1 < argc ? argv[++i] : "";
+                char *end;
+                long val = std::strtol(arg, &end, 10);
+                if (*arg == '\0' || *end != '\0' || val < 1 || val > 1024)
+                    usage(argv[0]);
+                jobs = val;
+                jobs_given = true;
             } else {
                 usage(argv[0]);
             }
         } else {
-            if (!opened) {
-                if (std::freopen(argv[i], "r", stdin) == nullptr) {
-                    fprintf(stderr, "failed to open file '%s'\n", argv[i]);
-                    exit(EXIT_FAILURE);
-                }
-                opened = true;
-            } else {
-                if (chdir(argv[i]) < 0) {
-                    perror("chdir");
-                    exit(EXIT_FAILURE);
-                }
-            }
+            inputs.push_back(argv[i]);
         }
     }
+    if (!output_dir && !jobs_given && inputs.size() == 2 && is_directory(inputs.back())) {
+        output_dir = inputs.back();
+        inputs.pop_back();
+    }
+    if (convert_to && inputs.size() > 1)
+        usage(argv[0]);
+    std::string cwd;
+    if (output_dir) {
+        std::unique_ptr<char, decltype(&std::free)> dir(getcwd(nullptr, 0), std::free);
+        if (!dir) {
+            perror("getcwd");
+            exit(EXIT_FAILURE);
+        }
+        cwd = dir.get() + std::string("/");
+    }
+    for (const char *input : inputs)
+        paths.push_back(input[0] == '/' ? input : cwd + input);
+    if (output_dir && chdir(output_dir) < 0) {
+        perror("chdir");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int open_input(size_t i) {
+    int fd = open(paths[i].c_str(), O_RDONLY);
+    if (fd < 0) fprintf(stderr, "failed to open file '%s'\n", inputs[i]);
+    return fd;
+}
+
+// Runs every input in a session of its own on a pool of jobs threads. The
+// errors of a script are printed together once it is done, prefixed with
+// its name. Returns whether every input could be opened.
+static bool run_all() {
+    std::atomic<size_t> next(0);
+    std::atomic<bool> ok(true);
+    std::mutex output;
+    auto worker = [&] {
+        for (size_t i; (i = next++) < inputs.size(); ) {
+            int fd = open_input(i);
+            if (fd < 0) {
+                ok = false;
+                continue;
+            }
+            std::ostringstream err;
+            Session session(mathcoord, err, inputs[i]);
+            // the pool already keeps the cores busy
+            session.set_parallel_parse(jobs == 1);
+            session.run(fd);
+            close(fd);
+            std::lock_guard<std::mutex> lock(output);
+            std::cerr << err.str() << std::flush;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < jobs && i < inputs.size(); i++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& thread : pool) thread.join();
+    return ok;
 }
 
 int main(int argc, char *argv[]) {
     parsearg(argc, argv);
-    batch();
+    if (inputs.size() > 1)
+        return run_all() ? EXIT_SUCCESS : EXIT_FAILURE;
+    int input_fd = STDIN_FILENO;
+    if (!inputs.empty() && (input_fd = open_input(0)) < 0)
+        exit(EXIT_FAILURE);
+    if (convert_to) {
+        try {
+            convert(input_fd, convert_to);
+        } catch (const std::exception& ex) {
+            fprintf(stderr, "%s\n", ex.what());
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        Session(mathcoord).run(input_fd);
+    }
     return 0;    
 }
@@ -0,0 +1,447 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <vector>
+#include <string>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <paint/paint.h>
+#include <paint/primitive.h>
+#include <paint/util.h>
+
+#include "script.h"
+
+using util::limit_range;
+using Script::Opcode;
+using Script::Command;
+using Script::Program;
+
+// A whitespace-delimited token referring into the script text.
+struct Token {
+    const char *begin;
+    size_t len;
+
+    template <size_t N>
+    bool is(const char (&str)[N]) const {
+        return len == N - 1 && std::memcmp(begin, str, N - 1) == 0;
+    }
+
+    std::string str() const { return std::string(begin, len); }
+};
+
+static bool next_token(const char *&pos, const char *end, Token& tok) {
+    while (pos != end && std::isspace((unsigned char)*pos)) pos++;
+    if (pos == end) return false;
+    tok.begin = pos;
+    while (pos != end && !std::isspace((unsigned char)*pos)) pos++;
+    tok.len = pos - tok.begin;
+    return true;
+}
+
+// Tokens of a command line. Tokens beyond MAX_ARGS are counted but not
+// kept, since no command takes that many.
+struct Args {
+    static constexpr size_t MAX_ARGS = 8;
+    Token tok[MAX_ARGS];
+    size_t size = 0;
+
+    Args(const char *begin, const char *end) {
+        Token t;
+        while (next_token(begin, end, t))
+            if (size++ < MAX_ARGS) tok[size - 1] = t;
+    }
+
+    const Token& operator[] (size_t i) const { return tok[i]; }
+};
+
+template <typename T>
+static T convert(const char *str, char **stop);
+
+template <>
+long long convert<long long>(const char *str, char **stop) { return std::strtoll(str, stop, 10); }
+
+template <>
+float convert<float>(const char *str, char **stop) { return std::strtof(str, stop); }
+
+// Converts str, which must be a number and nothing else.
+template <typename T>
+static T convert(const char *str) {
+    char *stop;
+    T val = convert<T>(str, &stop);
+    if (stop == str || *stop != '\0')
+        throw std::invalid_argument("invalid argument '" + std::string(str) + "'");
+    return val;
+}
+
+// Converts a token to a number without allocating for ordinary tokens.
+template <typename T = long long>
+static T to_number(const Token& tok) {
+    char buf[64];
+    if (tok.len < sizeof(buf)) {
+        std::memcpy(buf, tok.begin, tok.len);
+        buf[tok.len] = '\0';
+        return convert<T>(buf);
+    }
+    return convert<T>(tok.str().c_str());
+}
+
+static Paint::Line::Algorithm line_algorithm(const Token& tok) {
+    if (tok.is("DDA"))              return Paint::Line::Algorithm::DDA;
+    if (tok.is("Bresenham"))        return Paint::Line::Algorithm::Bresenham;
+    if (tok.is("FixedDDA"))         return Paint::Line::Algorithm::FixedDDA;
+    throw std::invalid_argument("unknown line drawing algorithm '" + tok.str() + "'");
+}
+
+static Paint::CurveDrawingAlgorithm curve_algorithm(const Token& tok) {
+    if (tok.is("Bezier"))           return Paint::CurveDrawingAlgorithm::Bezier;
+    if (tok.is("BSpline"))          return Paint::CurveDrawingAlgorithm::BSpline;
+    if (tok.is("CubicBezier"))      return Paint::CurveDrawingAlgorithm::CubicBezier;
+    throw std::invalid_argument("unrecognized curve type");
+}
+
+static Paint::LineClippingAlgorithm clip_algorithm(const Token& tok) {
+    if (tok.is("Cohen-Sutherland")) return Paint::LineClippingAlgorithm::CohenSutherland;
+    if (tok.is("Liang-Barsky"))     return Paint::LineClippingAlgorithm::LiangBarsky;
+    throw std::invalid_argument("unknown clipping algorithm '" + tok.str() + "'");
+}
+
+// Maps a command name to its opcode by length, then by content.
+// Opcode::Error stands for an unknown command.
+static Opcode find_opcode(const Token& tok) {
+    switch (tok.len) {
+    case 4:
+        if (tok.is("clip"))         return Opcode::Clip;
+        if (tok.is("fill"))         return Opcode::Fill;
+        break;
+    case 5:
+        if (tok.is("scale"))        return Opcode::Scale;
+        break;
+    case 6:
+        if (tok.is("resize"))       return Opcode::Resize;
+        if (tok.is("rotate"))       return Opcode::Rotate;
+        break;
+    case 8:
+        if (tok.is("drawLine"))     return Opcode::DrawLine;
+        if (tok.is("setColor"))     return Opcode::SetColor;
+        if (tok.is("setWidth"))     return Opcode::SetWidth;
+        break;
+    case 9:
+        if (tok.is("drawCurve"))    return Opcode::DrawCurve;
+        if (tok.is("translate"))    return Opcode::Translate;
+        break;
+    case 10:
+        if (tok.is("saveCanvas"))   return Opcode::SaveCanvas;
+        break;
+    case 11:
+        if (tok.is("defineShape"))  return Opcode::DefineShape;
+        if (tok.is("instantiate"))  return Opcode::Instantiate;
+        if (tok.is("drawPolygon"))  return Opcode::DrawPolygon;
+        if (tok.is("drawEllipse"))  return Opcode::DrawEllipse;
+        if (tok.is("resetCanvas"))  return Opcode::ResetCanvas;
+        break;
+    case 12:
+        if (tok.is("saveSnapshot")) return Opcode::SaveSnapshot;
+        if (tok.is("loadSnapshot")) return Opcode::LoadSnapshot;
+        if (tok.is("setAntialias")) return Opcode::SetAntialias;
+        break;
+    }
+    return Opcode::Error;
+}
+
+// Splits [begin, end) into lines, dropping comments.
+class LineReader {
+public:
+    LineReader(const char *begin, const char *end, int first_line) :
+        pos(begin), last(end), line(first_line - 1) { }
+
+    bool readline(const char *&begin, const char *&end) {
+        if (pos == last) return false;
+        const char *newline = static_cast<const char*>(
+            std::memchr(pos, '\n', last - pos));
+        begin = pos;
+        end = newline ? newline : last;
+        pos = newline ? newline + 1 : last;
+        const char *hash = static_cast<const char*>(
+            std::memchr(begin, '#', end - begin));
+        if (hash) end = hash;
+        line++;
+        return true;
+    }
+
+    int lineno() const { return line; }
+
+private:
+    const char *pos, *last;
+    int line;
+};
+
+// Parses the coordinate line of a polygon or curve in place.
+static void read_points(const char *begin, const char *end,
+                        size_t nr_point, Command& cmd, Program& prog) {
+    std::vector<float> coords;
+    coords.reserve(nr_point * 2);
+    Token tok;
+    while (next_token(begin, end, tok))
+        coords.push_back(to_number<float>(tok));
+    if (coords.size() != nr_point * 2)
+        throw std::invalid_argument("invalid number of coordinates");
+    cmd.first = prog.points.size();
+    cmd.count = nr_point;
+    for (size_t i = 0; i < nr_point; i++)
+        prog.points.emplace_back(coords[i*2], coords[i*2+1]);
+}
+
+using CommandParser = void (*)(const Args& args,
+                               Command& cmd, Program& prog, LineReader& in);
+
+static void parse_size(const Args& args,
+                       Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 3) 
+        throw std::invalid_argument("invalid argument number");
+    cmd.arg[0] = limit_range<size_t>(to_number(args[1]), 
+                    0, Paint::MAX_COORDINATE);
+    cmd.arg[1] = limit_range<size_t>(to_number(args[2]),
+                    0, Paint::MAX_COORDINATE);
+}
+
+static void parse_filename(const Args& args,
+                           Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 2)
+        throw std::invalid_argument("invalid argument number");
+    cmd.first = prog.strings.size();
+    cmd.count = 1;
+    prog.strings.push_back(args[1].str());
+}
+
+static void parse_setColor(const Args& args,
+                           Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 4)
+        throw std::invalid_argument("invalid argument number");
+    for (int i = 0; i < 3; i++)
+        cmd.arg[i] = limit_range<uint8_t>(to_number(args[i + 1]));
+}
+
+static void parse_setAntialias(const Args& args,
+                               Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 2)
+        throw std::invalid_argument("invalid argument number");
+    if (args[1].is("on")) {
+        cmd.arg[0] = 1;
+    } else if (args[1].is("off")) {
+        cmd.arg[0] = 0;
+    } else throw std::invalid_argument("expected 'on' or 'off'");
+}
+
+static void parse_setWidth(const Args& args,
+                           Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 2)
+        throw std::invalid_argument("invalid argument number");
+    cmd.arg[0] = limit_range<float>(to_number<float>(args[1]),
+                    1.0f, Paint::MAX_STROKE_WIDTH);
+}
+
+static void parse_drawLine(const Args& args,
+                           Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 7) 
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    for (int i = 0; i < 4; i++)
+        cmd.arg[i] = to_number<float>(args[i + 2]);
+    cmd.algo = static_cast<uint8_t>(line_algorithm(args[6]));
+}
+
+static void parse_drawPolygon(const Args& args,
+                              Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 4) 
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    size_t nr_point = 
+        limit_range<size_t>(to_number(args[2]), 2, 1000000);
+    cmd.algo = static_cast<uint8_t>(line_algorithm(args[3]));
+    const char *begin, *end;
+    if (!in.readline(begin, end))
+        throw std::invalid_argument("points of polygon expected");
+    cmd.line = in.lineno();
+    read_points(begin, end, nr_point, cmd, prog);
+}
+
+static void parse_drawEllipse(const Args& args,
+                              Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 6) 
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    for (int i = 0; i < 4; i++)
+        cmd.arg[i] = to_number<float>(args[i + 2]);
+}
+
+static void parse_drawCurve(const Args& args,
+                            Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 4)
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    size_t nr_point =
+        limit_range<size_t>(to_number(args[2]), 2, 1000000);
+    const char *begin, *end;
+    if (!in.readline(begin, end))
+        throw std::invalid_argument("points of curve expected");
+    cmd.line = in.lineno();
+    read_points(begin, end, nr_point, cmd, prog);
+    cmd.algo = static_cast<uint8_t>(curve_algorithm(args[3]));
+}
+
+static void parse_fill(const Args& args,
+                       Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 4)
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    cmd.arg[0] = to_number<float>(args[2]);
+    cmd.arg[1] = to_number<float>(args[3]);
+}
+
+// The algorithm of a shape tells whether it is a polygon (kind 0) drawn
+// with a line algorithm or a curve (kind 1) of the given type.
+static void parse_defineShape(const Args& args,
+                              Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 4)
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    size_t nr_point =
+        limit_range<size_t>(to_number(args[2]), 2, 1000000);
+    if (args[3].is("DDA") || args[3].is("Bresenham") || args[3].is("FixedDDA")) {
+        cmd.algo = static_cast<uint8_t>(line_algorithm(args[3]));
+    } else {
+        cmd.arg[0] = 1;
+        cmd.algo = static_cast<uint8_t>(curve_algorithm(args[3]));
+    }
+    const char *begin, *end;
+    if (!in.readline(begin, end))
+        throw std::invalid_argument("points of shape expected");
+    cmd.line = in.lineno();
+    read_points(begin, end, nr_point, cmd, prog);
+}
+
+// Shape ids are kept in a float argument, so they are limited to the
+// integers a float holds exactly.
+static void parse_instantiate(const Args& args,
+                              Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 5)
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    cmd.arg[0] = limit_range<int>(to_number(args[2]), 0, Script::MAX_SHAPE_ID);
+    cmd.arg[1] = to_number<float>(args[3]);
+    cmd.arg[2] = to_number<float>(args[4]);
+}
+
+static void parse_translate(const Args& args,
+                            Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 4) 
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    cmd.arg[0] = to_number<float>(args[2]);
+    cmd.arg[1] = -to_number<float>(args[3]);
+}
+
+static void parse_transform(const Args& args,
+                            Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 5) 
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    for (int i = 0; i < 3; i++)
+        cmd.arg[i] = to_number<float>(args[i + 2]);
+}
+
+static void parse_clip(const Args& args,
+                       Command& cmd, Program& prog, LineReader& in) {
+    if (args.size != 7)
+        throw std::invalid_argument("invalid argument number");
+    cmd.id = to_number(args[1]);
+    for (int i = 0; i < 4; i++)
+        cmd.arg[i] = to_number<float>(args[i + 2]);
+    cmd.algo = static_cast<uint8_t>(clip_algorithm(args[6]));
+}
+
+// indexed by Script::Opcode
+static const CommandParser parser[] {
+    nullptr,
+    parse_size,
+    parse_size,
+    parse_filename,
+    parse_setColor,
+    parse_drawLine,
+    parse_drawPolygon,
+    parse_drawEllipse,
+    parse_drawCurve,
+    parse_translate,
+    parse_transform,
+    parse_transform,
+    parse_clip,
+    parse_filename,
+    parse_filename,
+    parse_setAntialias,
+    parse_setWidth,
+    parse_fill,
+    parse_defineShape,
+    parse_instantiate,
+};
+
+namespace Script {
+
+    Program parse(const char *begin, const char *end, int first_line) {
+        Program prog;
+        LineReader in(begin, end, first_line);
+        const char *lbegin, *lend;
+        while (in.readline(lbegin, lend)) {
+            Args args(lbegin, lend);
+            if (args.size == 0) continue;
+            Command cmd = {};
+            cmd.line = in.lineno();
+            cmd.op = find_opcode(args[0]);
+            size_t nr_point = prog.points.size();
+            try {
+                if (cmd.op == Opcode::Error)
+                    throw std::invalid_argument(
+                        "unknown command '" + args[0].str() + "'");
+                parser[static_cast<int>(cmd.op)](args, cmd, prog, in);
+            } catch (const std::exception& ex) {
+                prog.points.resize(nr_point);
+                cmd.op = Opcode::Error;
+                cmd.line = in.lineno();
+                cmd.first = prog.strings.size();
+                cmd.count = 1;
+                prog.strings.emplace_back(ex.what());
+            }
+            prog.commands.push_back(cmd);
+        }
+        return prog;
+    }
+
+    bool takes_next_line(const char *begin, const char *end) {
+        const char *hash = static_cast<const char*>(
+            std::memchr(begin, '#', end - begin));
+        if (hash) end = hash;
+        Token tok;
+        if (!next_token(begin, end, tok)) return false;
+        Opcode op = find_opcode(tok);
+        return op == Opcode::DrawPolygon || op == Opcode::DrawCurve ||
+               op == Opcode::DefineShape;
+    }
+}
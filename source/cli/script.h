@@ -0,0 +1,98 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __CLI_SCRIPT_H__
+#define __CLI_SCRIPT_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <paint/paint.h>
+
+#include "input.h"
+
+namespace Script {
+
+    enum class Opcode : uint8_t {
+        Error, ResetCanvas, Resize, SaveCanvas, SetColor, DrawLine,
+        DrawPolygon, DrawEllipse, DrawCurve, Translate, Rotate, Scale, Clip,
+        SaveSnapshot, LoadSnapshot, SetAntialias, SetWidth,
+        Fill, DefineShape, Instantiate,
+    };
+
+    // A parsed command. Numeric arguments are stored in order of appearance
+    // (after the id); y coordinates are kept as written and converted to
+    // device coordinates when the command is executed. Point lists, file
+    // names and error messages live in the owning Program and are referred
+    // to by [first, first + count).
+    struct Command {
+        Opcode op;
+        uint8_t algo;
+        int line;
+        int id;
+        float arg[4];
+        uint32_t first, count;
+    };
+
+    // Largest shape id accepted by instantiate.
+    constexpr int MAX_SHAPE_ID = (1 << 24) - 1;
+
+    struct Program {
+        std::vector<Command> commands;
+        std::vector<Paint::PointF> points;
+        std::vector<std::string> strings;
+    };
+
+    // Parses the lines in [begin, end); first_line is the line number of
+    // the first line. Errors are recorded as Opcode::Error commands so that
+    // they are reported in order when the program is executed.
+    Program parse(const char *begin, const char *end, int first_line);
+
+    // Whether the given line is a command header that takes the following
+    // line as its point list. Scripts must not be split right after it.
+    bool takes_next_line(const char *begin, const char *end);
+
+    // Binary script format. All fields are little-endian. The file starts
+    // with the 8-byte magic followed by a 32-bit version and 32 reserved
+    // bits, then a sequence of 32-byte records:
+    //
+    //      u8 opcode, u8 algo, u16 reserved, i32 line, i32 id,
+    //      f32 arg[4], u32 count
+    //
+    // DrawPolygon, DrawCurve and DefineShape records are followed by count
+    // (x, y) pairs of f32; SaveCanvas, SaveSnapshot, LoadSnapshot and Error
+    // records by count bytes of text padded to a multiple of 4.
+    extern const char BINARY_MAGIC[8];
+    constexpr uint32_t BINARY_VERSION = 1;
+
+    void write_binary_header(std::string& out);
+    void write_binary(std::string& out, const Program& prog);
+
+    // Returns false if the input is not a binary script. Throws
+    // std::runtime_error if it is of another version.
+    bool read_binary_header(BatchInput& in);
+    // Reads up to max_commands records into prog. Returns false at the end
+    // of input. Throws std::runtime_error on a malformed record, leaving
+    // the records before it in prog; the input cannot be read any further
+    // then.
+    bool read_binary(BatchInput& in, Program& prog, size_t max_commands);
+}
+
+#endif
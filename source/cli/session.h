@@ -0,0 +1,101 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __CLI_SESSION_H__
+#define __CLI_SESSION_H__
+
+#include <iostream>
+#include <string>
+
+#include <paint/paint.h>
+#include <paint/canvas.h>
+
+#include <libbmp.h>
+
+#include "script.h"
+
+// One run of a batch script: the canvas, the drawing state and where errors
+// are reported. Sessions share no state, so a process may run any number
+// of them at once, each on its own thread.
+class Session {
+public:
+    // Errors are written to err, prefixed with name if it is not empty.
+    explicit Session(bool mathcoord = false, std::ostream& err = std::cerr,
+                     const std::string& name = std::string());
+
+    Session(const Session& other) = delete;
+    Session& operator = (const Session& other) = delete;
+
+    // Runs the text or binary script on fd. A failing command is reported
+    // and the rest of the script still runs.
+    void run(int fd);
+    void execute(const Script::Program& prog);
+
+    // Whether run parses text scripts on several threads, which is the
+    // default. Sessions running side by side should each parse on their own.
+    void set_parallel_parse(bool parallel) { parallel_parse = parallel; }
+
+private:
+    using Handler = void (Session::*)(const Script::Command& cmd,
+                                      const Script::Program& prog);
+    // indexed by Script::Opcode
+    static const Handler handler[];
+
+    std::ostream& report();
+    float read_y(float val);
+    template <typename PointT>
+    std::vector<PointT> read_points(const Script::Command& cmd, const Script::Program& prog);
+    template <typename T>
+    T* styled(T *prim);
+
+    void error(const Script::Command& cmd, const Script::Program& prog);
+    void resetCanvas(const Script::Command& cmd, const Script::Program& prog);
+    void resize(const Script::Command& cmd, const Script::Program& prog);
+    void saveCanvas(const Script::Command& cmd, const Script::Program& prog);
+    void setColor(const Script::Command& cmd, const Script::Program& prog);
+    void setAntialias(const Script::Command& cmd, const Script::Program& prog);
+    void setWidth(const Script::Command& cmd, const Script::Program& prog);
+    void drawLine(const Script::Command& cmd, const Script::Program& prog);
+    void drawPolygon(const Script::Command& cmd, const Script::Program& prog);
+    void drawEllipse(const Script::Command& cmd, const Script::Program& prog);
+    void drawCurve(const Script::Command& cmd, const Script::Program& prog);
+    void fill(const Script::Command& cmd, const Script::Program& prog);
+    void defineShape(const Script::Command& cmd, const Script::Program& prog);
+    void instantiate(const Script::Command& cmd, const Script::Program& prog);
+    void translate(const Script::Command& cmd, const Script::Program& prog);
+    void rotate(const Script::Command& cmd, const Script::Program& prog);
+    void scale(const Script::Command& cmd, const Script::Program& prog);
+    void clip(const Script::Command& cmd, const Script::Program& prog);
+    void saveSnapshot(const Script::Command& cmd, const Script::Program& prog);
+    void loadSnapshot(const Script::Command& cmd, const Script::Program& prog);
+
+    bool mathcoord;
+    std::ostream& err;
+    std::string name;
+    Paint::Canvas<LibBmp::TiledBmpDevice> canvas;
+    Paint::RGBColor forecolor;
+    bool antialias = false;
+    float stroke_width = 1.0f;
+    bool parallel_parse = true;
+};
+
+// Converts the text script on fd to binary form, written to filename.
+void convert(int fd, const char *filename);
+
+#endif
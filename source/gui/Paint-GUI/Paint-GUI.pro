@@ -30,6 +30,8 @@ SOURCES += \
         command.cpp \
         main.cpp \
         mainwindow.cpp \
+        primitivelistmodel.cpp \
+        renderthread.cpp \
         $$PWD/../../src/*.cpp \
         $$PWD/../../src/primitive/*.cpp
 
@@ -37,7 +39,9 @@ HEADERS += \
         command.h \
         device.h \
         mainwindow.h \
-        movablelabel.h
+        primitivelistmodel.h \
+        renderthread.h \
+        canvaswidget.h
 
 INCLUDEPATH += $$PWD/../../include
 
@@ -0,0 +1,128 @@
+#ifndef CANVASWIDGET_H
+#define CANVASWIDGET_H
+
+#include <algorithm>
+#include <cstring>
+#include <QWidget>
+#include <QImage>
+#include <QPainter>
+#include <QRegion>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QWheelEvent>
+
+// Shows the canvas by drawing its own copy of the last presented frame
+// straight from a QImage, so a refresh neither converts the image to a
+// QPixmap nor repaints more of the widget than has changed. The widget
+// spans the whole canvas at the current zoom, but a frame only covers the
+// part of it that is visible; areas it does not cover are drawn white and
+// reported through exposed().
+class CanvasWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit CanvasWidget(QWidget* parent = nullptr) : QWidget(parent) {}
+    ~CanvasWidget() override = default;
+
+    // Copies the pixels of image, to be shown with its top left corner at
+    // origin, that differ from the current frame and schedules a repaint of
+    // their bounding rectangle only.
+    void present(const QImage& image, const QPoint& origin) {
+        present(image, origin, image.rect());
+    }
+
+    // Same, for an image known to differ from the frame only within area.
+    void present(const QImage& image, const QPoint& origin, const QRect& area) {
+        if (frame.size() != image.size() || frame.format() != image.format() ||
+            frame_origin != origin) {
+            frame = image.copy();
+            frame_origin = origin;
+            update();
+            return;
+        }
+        QRect scan = area & image.rect();
+        if (scan.isEmpty()) return;
+        int top = -1, bottom = -1, left = scan.right() + 1, right = scan.left() - 1;
+        size_t row_bytes = size_t(scan.width()) * sizeof(QRgb);
+        for (int y = scan.top(); y <= scan.bottom(); y++) {
+            const QRgb *src = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            const QRgb *dst = reinterpret_cast<const QRgb*>(frame.constScanLine(y));
+            if (std::memcmp(src + scan.left(), dst + scan.left(), row_bytes) == 0) continue;
+            int l = scan.left(), r = scan.right();
+            while (src[l] == dst[l]) l++;
+            while (src[r] == dst[r]) r--;
+            if (top < 0) top = y;
+            bottom = y;
+            left = std::min(left, l);
+            right = std::max(right, r);
+        }
+        if (top < 0) return;
+        for (int y = top; y <= bottom; y++)
+            std::memcpy(reinterpret_cast<QRgb*>(frame.scanLine(y)) + left,
+                        reinterpret_cast<const QRgb*>(image.constScanLine(y)) + left,
+                        size_t(right - left + 1) * sizeof(QRgb));
+        update(QRect(QPoint(left, top), QPoint(right, bottom)).translated(frame_origin));
+    }
+
+    // Drops the frame, which no longer matches the canvas, such as after
+    // zooming.
+    void discard() {
+        frame = QImage();
+        update();
+    }
+
+signals:
+    void mouseMoved(int x, int y);
+    void mouseClicked(int x, int y);
+    void mouseRightClicked(int x, int y);
+    // Ctrl + wheel by delta eighths of a degree with the cursor at (x, y).
+    void zoomed(int delta, int x, int y);
+    // Part of the widget that the frame does not cover was painted.
+    void exposed();
+
+private:
+    QImage frame;
+    QPoint frame_origin;
+
+    void paintEvent(QPaintEvent *event) override {
+        QPainter painter(this);
+        QRect shown = event->rect() & frame.rect().translated(frame_origin);
+        if (!shown.isEmpty())
+            painter.drawImage(shown, frame, shown.translated(-frame_origin));
+        if (shown != event->rect()) {
+            painter.setClipRegion(QRegion(event->rect()) - QRegion(shown));
+            painter.fillRect(event->rect(), Qt::white);
+            emit exposed();
+        }
+    }
+
+    void wheelEvent(QWheelEvent *event) override {
+        if (!(event->modifiers() & Qt::ControlModifier)) {
+            event->ignore();
+            return;
+        }
+        emit zoomed(event->angleDelta().y(), event->pos().x(), event->pos().y());
+        event->accept();
+    }
+
+    void mouseMoveEvent(QMouseEvent *event) override {
+        emit mouseMoved(event->x(), event->y());
+    }
+
+    void mousePressEvent(QMouseEvent *event) override {
+        switch (event->button()) {
+        case Qt::MouseButton::LeftButton :
+            emit mouseClicked(event->x(), event->y());
+            break;
+        case Qt::MouseButton::RightButton  :
+            emit mouseRightClicked(event->x(), event->y());
+            break;
+        default :
+            break;
+        }
+    }
+
+};
+
+#endif // CANVASWIDGET_H
@@ -5,6 +5,132 @@
 #include <QMessageBox>
 using namespace std;
 
+// PresenceEdit
+
+void PresenceEdit::undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    toggle(canvas, damage);
+}
+
+void PresenceEdit::redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    toggle(canvas, damage);
+}
+
+void PresenceEdit::toggle(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    if (held) {
+        damage.add(*held);
+        canvas.primitives.emplace(id, std::move(held));
+    } else {
+        auto it = canvas.primitives.find(id);
+        damage.add(*it->second);
+        held = std::move(it->second);
+        canvas.primitives.erase(it);
+    }
+}
+
+// The geometry of a held primitive dominates its size.
+size_t PresenceEdit::footprint() const {
+    size_t size = sizeof(*this);
+    if (!held) return size;
+    switch (held->type()) {
+    case Paint::Primitive::Type::Polygon:
+        return size + sizeof(Paint::Polygon) +
+               static_cast<Paint::Polygon&>(*held).points.size() * sizeof(std::pair<float, float>);
+    case Paint::Primitive::Type::Bezier:
+        return size + sizeof(Paint::Bezier) +
+               static_cast<Paint::Bezier&>(*held).points.size() * sizeof(Paint::PointF);
+    case Paint::Primitive::Type::BSpline: {
+        auto& bspline = static_cast<Paint::BSpline&>(*held);
+        return size + sizeof(Paint::BSpline) + bspline.points.size() * sizeof(Paint::PointF) +
+               bspline.get_knot().size() * sizeof(float);
+    }
+    default:
+        return size + sizeof(Paint::Ellipse);
+    }
+}
+
+// TransformEdit
+
+void TransformEdit::apply(Paint::Primitive& primitive, bool inverse) const {
+    switch (kind) {
+    case TRANSLATE:
+        if (inverse) primitive.translate(-x, -y);
+        else primitive.translate(x, y);
+        break;
+    case ROTATE:
+        primitive.rotate(x, y, inverse ? -amount : amount);
+        break;
+    case SCALE:
+        primitive.scale(x, y, inverse ? 1.0f / amount : amount);
+        break;
+    }
+}
+
+void TransformEdit::undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    Paint::Primitive& primitive = canvas[id];
+    damage.add(primitive);
+    apply(primitive, true);
+    damage.add(primitive);
+}
+
+void TransformEdit::redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    Paint::Primitive& primitive = canvas[id];
+    damage.add(primitive);
+    apply(primitive, false);
+    damage.add(primitive);
+}
+
+// ClipEdit
+
+void ClipEdit::set(Paint::Canvas<QImageDevice>& canvas, Damage& damage, const Paint::PointF *ends) {
+    auto& line = static_cast<Paint::Line&>(canvas[id]);
+    damage.add(line);
+    line.p1 = ends[0];
+    line.p2 = ends[1];
+    damage.add(line);
+}
+
+void ClipEdit::undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    set(canvas, damage, before);
+}
+
+void ClipEdit::redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    set(canvas, damage, after);
+}
+
+// History
+
+void History::record(std::unique_ptr<Edit> edit) {
+    if (!edit) return;
+    undone.clear();
+    done.push_back(std::move(edit));
+    trim();
+}
+
+void History::trim() {
+    size_t bytes = 0;
+    for (auto& edit : done) bytes += edit->footprint();
+    while (!done.empty() && (done.size() > MAX_EDITS || bytes > MAX_BYTES)) {
+        bytes -= done.front()->footprint();
+        done.pop_front();
+    }
+}
+
+bool History::undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    if (done.empty()) return false;
+    done.back()->undo(canvas, damage);
+    undone.push_back(std::move(done.back()));
+    done.pop_back();
+    return true;
+}
+
+bool History::redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) {
+    if (undone.empty()) return false;
+    undone.back()->redo(canvas, damage);
+    done.push_back(std::move(undone.back()));
+    undone.pop_back();
+    return true;
+}
+
 // trivial destructor
 
 Command::~Command() {}
@@ -44,6 +170,10 @@ Command::status LineCommand::abort() {
     return Command::ABORT;
 }
 
+std::unique_ptr<Edit> LineCommand::edit() {
+    return std::unique_ptr<Edit>(new PresenceEdit(elem_id));
+}
+
 // PolygonCommand
 
 PolygonCommand::PolygonCommand(Paint::Canvas<QImageDevice>& canvas, Paint::RGBColor color, Paint::Line::Algorithm algo,
@@ -75,6 +205,10 @@ Command::status PolygonCommand::abort() {
     return Command::ABORT;
 }
 
+std::unique_ptr<Edit> PolygonCommand::edit() {
+    return std::unique_ptr<Edit>(new PresenceEdit(elem_id));
+}
+
 // EllipseCommand
 
 EllipseCommand::EllipseCommand(Paint::Canvas<QImageDevice>& canvas, Paint::RGBColor color,
@@ -112,6 +246,10 @@ Command::status EllipseCommand::abort() {
     return Command::ABORT;
 }
 
+std::unique_ptr<Edit> EllipseCommand::edit() {
+    return std::unique_ptr<Edit>(new PresenceEdit(elem_id));
+}
+
 // BezierCommand
 
 BezierCommand::BezierCommand(Paint::Canvas<QImageDevice>& canvas, Paint::RGBColor color,
@@ -144,6 +282,10 @@ Command::status BezierCommand::abort() {
     return Command::ABORT;
 }
 
+std::unique_ptr<Edit> BezierCommand::edit() {
+    return std::unique_ptr<Edit>(new PresenceEdit(elem_id));
+}
+
 // BSplineCommand
 
 BSplineCommand::BSplineCommand(Paint::Canvas<QImageDevice>& canvas, Paint::RGBColor color,
@@ -176,13 +318,46 @@ Command::status BSplineCommand::abort() {
     return Command::ABORT;
 }
 
+std::unique_ptr<Edit> BSplineCommand::edit() {
+    return std::unique_ptr<Edit>(new PresenceEdit(elem_id));
+}
+
+// FillCommand
+
+FillCommand::FillCommand(Paint::Canvas<QImageDevice>& canvas, Paint::RGBColor color,
+                         QStatusBar *statusBar) :
+    Command(canvas, statusBar), color(color)
+{
+    showStatusTip("Please left click inside the region to fill.");
+}
+
+Command::status FillCommand::mouseClick(int x, int y) {
+    elem_id = canvas.add_primitive(new Paint::Fill(Paint::PointF(x, y), color));
+    return Command::DONE;
+}
+
+Command::status FillCommand::mouseMove(int x, int y) {
+    return Command::CONTINUE;
+}
+
+std::unique_ptr<Edit> FillCommand::edit() {
+    return std::unique_ptr<Edit>(new PresenceEdit(elem_id));
+}
+
 // MoveCommand
 
 MoveCommand::MoveCommand(Paint::Canvas<QImageDevice>& canvas, int id,
                          QStatusBar *statusBar) :
-    Command(canvas, statusBar), primitive(*canvas.primitives[id])
+    Command(canvas, statusBar), id(id), primitive(*canvas.primitives[id])
 {
+    // Dragging only translates by whole pixels, so the primitive is
+    // repainted from its cached raster.
+    primitive.set_raster_cache(true);
+}
 
+MoveCommand::~MoveCommand()
+{
+    primitive.set_raster_cache(false);
 }
 
 Command::status MoveCommand::mouseClick(int x, int y) {
@@ -190,7 +365,7 @@ Command::status MoveCommand::mouseClick(int x, int y) {
         return Command::DONE;
     } else {
         phase++;
-        lastv = Paint::PointF(x, y);
+        firstv = lastv = Paint::PointF(x, y);
         showStatusTip("Please left click to finish.");
         return Command::CONTINUE;
     }
@@ -207,11 +382,22 @@ Command::status MoveCommand::mouseMove(int x, int y) {
     }
 }
 
+// An aborted transform is taken back.
+Command::status MoveCommand::abort() {
+    primitive.translate(firstv.x - lastv.x, firstv.y - lastv.y);
+    return Command::ABORT;
+}
+
+std::unique_ptr<Edit> MoveCommand::edit() {
+    return std::unique_ptr<Edit>(new TransformEdit(id, TransformEdit::TRANSLATE,
+                                                   lastv.x - firstv.x, lastv.y - firstv.y));
+}
+
 // RotateCommand
 
 RotateCommand::RotateCommand(Paint::Canvas<QImageDevice>& canvas, int id,
                              QStatusBar *statusBar) :
-    Command(canvas, statusBar), primitive(*canvas.primitives[id])
+    Command(canvas, statusBar), id(id), primitive(*canvas.primitives[id])
 {
 
 }
@@ -237,7 +423,9 @@ Command::status RotateCommand::mouseMove(int x, int y) try {
     if (phase == 2) {
         Paint::PointF nbase(x, y);
         float ratio = (nbase - center).arg() - (base - center).arg();
-        primitive.rotate(center.x, center.y, ratio / acos(-1) * 180.0);
+        float rdeg = ratio / acos(-1) * 180.0;
+        primitive.rotate(center.x, center.y, rdeg);
+        degrees += rdeg;
         base = nbase;
         return status::REFRESH;
     } else {
@@ -245,14 +433,25 @@ Command::status RotateCommand::mouseMove(int x, int y) try {
     }
 } catch (std::runtime_error& error) {
     QMessageBox::warning(nullptr, "Paint", QString("Runtime error: ") + error.what());
+    return abort();
+}
+
+Command::status RotateCommand::abort() {
+    if (degrees != 0.0f)
+        primitive.rotate(center.x, center.y, -degrees);
     return status::ABORT;
 }
 
+std::unique_ptr<Edit> RotateCommand::edit() {
+    return std::unique_ptr<Edit>(new TransformEdit(id, TransformEdit::ROTATE,
+                                                   center.x, center.y, degrees));
+}
+
 // ScaleCommand
 
 ScaleCommand::ScaleCommand(Paint::Canvas<QImageDevice>& canvas, int id,
                            QStatusBar *statusBar) :
-    Command(canvas, statusBar), primitive(*canvas.primitives[id])
+    Command(canvas, statusBar), id(id), primitive(*canvas.primitives[id])
 {
 
 }
@@ -278,7 +477,11 @@ Command::status ScaleCommand::mouseMove(int x, int y) {
     if (phase == 2) {
         Paint::PointF nbase(x, y);
         float ratio = (nbase - center).abs() / (base - center).abs();
+        // Scaling to nothing could not be undone.
+        if (!std::isfinite(ratio) || ratio == 0.0f)
+            return status::CONTINUE;
         primitive.scale(center.x, center.y, ratio);
+        factor *= ratio;
         base = nbase;
         return status::REFRESH;
     } else {
@@ -286,13 +489,23 @@ Command::status ScaleCommand::mouseMove(int x, int y) {
     }
 }
 
+Command::status ScaleCommand::abort() {
+    primitive.scale(center.x, center.y, 1.0f / factor);
+    return status::ABORT;
+}
+
+std::unique_ptr<Edit> ScaleCommand::edit() {
+    return std::unique_ptr<Edit>(new TransformEdit(id, TransformEdit::SCALE,
+                                                   center.x, center.y, factor));
+}
+
 // ClipCommand
 
-ClipCommand::ClipCommand(Paint::Canvas<QImageDevice>& canvas,
+ClipCommand::ClipCommand(Paint::Canvas<QImageDevice>& canvas, int id,
                          Paint::Line &line,
                          Paint::LineClippingAlgorithm algo,
                          QStatusBar *statusBar) :
-    Command(canvas, statusBar), line(line), algo(algo)
+    Command(canvas, statusBar), id(id), line(line), p1(line.p1), p2(line.p2), algo(algo)
 {
 
 }
@@ -335,6 +548,10 @@ Command::status ClipCommand::mouseClick(int x, int y) {
     }
 }
 
+std::unique_ptr<Edit> ClipCommand::edit() {
+    return std::unique_ptr<Edit>(new ClipEdit(id, p1, p2, line));
+}
+
 ClipCommand::~ClipCommand() {
     if (boxid >= 0) {
         canvas.primitives.erase(boxid);
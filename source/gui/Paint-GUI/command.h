@@ -5,9 +5,111 @@
 #include "device.h"
 #include "paint/canvas.h"
 #include "paint/primitive.h"
+#include <deque>
 #include <memory>
+#include <vector>
+#include <QRectF>
 #include <QStatusBar>
 
+// The part of the canvas an edit changed, grown by the box of each primitive
+// it touched before and after the change. A primitive without a box, such
+// as a fill, may have changed any part of it.
+struct Damage {
+    bool all = false;
+    QRectF rect;
+    // The primitive touched last.
+    const Paint::Primitive *primitive = nullptr;
+
+    void add(const Paint::Primitive& primitive) {
+        this->primitive = &primitive;
+        Paint::PointF min, max;
+        if (!primitive.bounds(min, max))
+            all = true;
+        else
+            rect |= QRectF(QPointF(min.x, min.y), QPointF(max.x, max.y));
+    }
+};
+
+// A change a finished command made to the canvas, as a delta that can be
+// undone and redone, not a copy of what it changed.
+class Edit {
+public:
+    virtual ~Edit() = default;
+    virtual void undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) = 0;
+    virtual void redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) = 0;
+    // Roughly how many bytes the edit keeps alive.
+    virtual size_t footprint() const { return sizeof(*this); }
+};
+
+// A primitive added to or removed from the canvas, by id. Undoing and
+// redoing both toggle whether it is there, and the edit holds the primitive
+// while it is off the canvas.
+class PresenceEdit : public Edit {
+public:
+    // The primitive with the given id is on the canvas.
+    explicit PresenceEdit(int id) : id(id) {}
+    void undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) override;
+    void redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) override;
+    size_t footprint() const override;
+
+private:
+    void toggle(Paint::Canvas<QImageDevice>& canvas, Damage& damage);
+    int id;
+    std::unique_ptr<Paint::Primitive> held;
+};
+
+// A translation by (x, y), a rotation about (x, y) by amount degrees or a
+// scaling about (x, y) by amount, undone by its inverse.
+class TransformEdit : public Edit {
+public:
+    enum Kind { TRANSLATE, ROTATE, SCALE };
+    TransformEdit(int id, Kind kind, float x, float y, float amount = 0.0f) :
+        id(id), kind(kind), x(x), y(y), amount(amount) {}
+    void undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) override;
+    void redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) override;
+    // Applies the transform, or its inverse, to primitive.
+    void apply(Paint::Primitive& primitive, bool inverse) const;
+
+private:
+    int id;
+    Kind kind;
+    float x, y, amount;
+};
+
+// A line whose end points were clipped.
+class ClipEdit : public Edit {
+public:
+    ClipEdit(int id, Paint::PointF p1, Paint::PointF p2, const Paint::Line& clipped) :
+        id(id), before{ p1, p2 }, after{ clipped.p1, clipped.p2 } {}
+    void undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) override;
+    void redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage) override;
+
+private:
+    void set(Paint::Canvas<QImageDevice>& canvas, Damage& damage, const Paint::PointF *ends);
+    int id;
+    Paint::PointF before[2], after[2];
+};
+
+// Edits of finished commands, to be undone and redone in order. Only the
+// latest MAX_EDITS are kept, and older ones are dropped as well while the
+// history keeps more than MAX_BYTES alive. Every change to the primitives
+// of the canvas must be recorded, as edits refer to them by id.
+class History {
+public:
+    static constexpr size_t MAX_EDITS = 1000, MAX_BYTES = size_t(64) << 20;
+
+    // Records an edit that was just made, forgetting what was undone.
+    void record(std::unique_ptr<Edit> edit);
+    // Return false if there is nothing to undo or redo.
+    bool undo(Paint::Canvas<QImageDevice>& canvas, Damage& damage);
+    bool redo(Paint::Canvas<QImageDevice>& canvas, Damage& damage);
+
+private:
+    void trim();
+    std::deque<std::unique_ptr<Edit>> done;
+    std::vector<std::unique_ptr<Edit>> undone;
+};
+
 class Command {
 public:
     enum status : int {
@@ -27,6 +129,11 @@ public:
     virtual status mouseRightClick(int x, int y) { return abort(); }
     virtual status mouseMove(int x, int y) = 0;
     virtual status abort() { return ABORT; }
+    // The primitive the command is editing, previewed on top of all the
+    // others while the command is active, or nullptr if there is none.
+    virtual Paint::Primitive *preview() { return nullptr; }
+    // The change the command made, once it is done.
+    virtual std::unique_ptr<Edit> edit() { return nullptr; }
 
 private:
     QStatusBar *statusBar = nullptr;
@@ -46,6 +153,8 @@ public:
     status mouseClick(int x, int y) override;
     status mouseMove(int x, int y) override;
     status abort() override;
+    Paint::Primitive *preview() override { return &line; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
     int phase = 0;
@@ -62,6 +171,8 @@ public:
     status mouseRightClick(int x, int y) override;
     status mouseMove(int x, int y) override;
     status abort() override;
+    Paint::Primitive *preview() override { return &polygon; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
     Paint::Polygon &polygon;
@@ -76,6 +187,8 @@ public:
     status mouseClick(int x, int y) override;
     status mouseMove(int x, int y) override;
     status abort() override;
+    Paint::Primitive *preview() override { return &ellipse; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
     int phase = 0;
@@ -92,6 +205,8 @@ public:
     status mouseRightClick(int x, int y) override;
     status mouseMove(int x, int y) override;
     status abort() override;
+    Paint::Primitive *preview() override { return &bezier; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
     Paint::Bezier &bezier;
@@ -107,23 +222,43 @@ public:
     status mouseRightClick(int x, int y) override;
     status mouseMove(int x, int y) override;
     status abort() override;
+    Paint::Primitive *preview() override { return &bspline; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
     Paint::BSpline &bspline;
     int elem_id;
 };
 
+class FillCommand : public Command {
+public:
+    explicit FillCommand(Paint::Canvas<QImageDevice>& canvas, Paint::RGBColor color,
+                         QStatusBar *statusBar = nullptr);
+    ~FillCommand() override = default;
+    status mouseClick(int x, int y) override;
+    status mouseMove(int x, int y) override;
+    std::unique_ptr<Edit> edit() override;
+
+private:
+    Paint::RGBColor color;
+    int elem_id = -1;
+};
+
 class MoveCommand : public Command {
 public:
     explicit MoveCommand(Paint::Canvas<QImageDevice>& canvas, int id,
                          QStatusBar *statusBar = nullptr);
-    ~MoveCommand() override = default;
+    ~MoveCommand() override;
     status mouseClick(int x, int y) override;
     status mouseMove(int x, int y) override;
+    status abort() override;
+    Paint::Primitive *preview() override { return &primitive; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
+    int id;
     Paint::Primitive &primitive;
-    Paint::PointF lastv;
+    Paint::PointF firstv, lastv;
     int phase = 0;
 };
 
@@ -134,10 +269,16 @@ public:
     ~RotateCommand() override = default;
     status mouseClick(int x, int y) override;
     status mouseMove(int x, int y) override;
+    status abort() override;
+    Paint::Primitive *preview() override { return &primitive; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
+    int id;
     Paint::Primitive &primitive;
     Paint::PointF center, base;
+    // The rotation, in degrees, applied so far.
+    float degrees = 0.0f;
     int phase = 0;
 };
 
@@ -149,27 +290,37 @@ public:
     ~ScaleCommand() override = default;
     status mouseClick(int x, int y) override;
     status mouseMove(int x, int y) override;
+    status abort() override;
+    Paint::Primitive *preview() override { return &primitive; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
+    int id;
     Paint::Primitive &primitive;
     Paint::PointF center, base;
+    // The scaling applied so far.
+    float factor = 1.0f;
     int phase = 0;
 };
 
 
 class ClipCommand : public Command {
 public:
-    explicit ClipCommand(Paint::Canvas<QImageDevice>& canvas,
+    explicit ClipCommand(Paint::Canvas<QImageDevice>& canvas, int id,
                          Paint::Line &line,
                          Paint::LineClippingAlgorithm algo,
                          QStatusBar *statusBar = nullptr);
     ~ClipCommand() override;
     status mouseClick(int x, int y) override;
     status mouseMove(int x, int y) override;
+    Paint::Primitive *preview() override { return boxid >= 0 ? box : nullptr; }
+    std::unique_ptr<Edit> edit() override;
 
 private:
     void updatePolygon();
+    int id;
     Paint::Line &line;
+    Paint::PointF p1, p2;
     Paint::LineClippingAlgorithm algo;
     Paint::PointF cd1, cd2;
     int boxid = -1;
@@ -1,5 +1,5 @@
+#include <algorithm>
 #include <QImage>
-#include <QPixmap>
 #include <paint/paint.h>
 #include <paint/device.h>
 
@@ -14,42 +14,175 @@ static inline QRgb paint_color_to_qrgb(Paint::RGBColor color) {
     return qRgb(color.red, color.green, color.blue);
 }
 
+// Reads and writes go straight to the pixel memory of image instead of
+// through QImage::pixel and QImage::setPixel, which check the coordinates
+// and may detach the image on every call. The memory is fetched, and the
+// image detached, once per frame by clear and whenever reset replaces the
+// image, so image must not be reassigned or written to directly.
 class QImageDevice : public Paint::ImageDevice
 {
+private:
+    QRgb *pixels = nullptr;
+    size_t stride = 0;
+
+    void attach() {
+        pixels = reinterpret_cast<QRgb*>(image.bits());
+        stride = image.bytesPerLine() / sizeof(QRgb);
+    }
+
+    QRgb *row(ssize_t y) const { return pixels + stride * y; }
+
 public:
     QImage image;
 
     explicit QImageDevice(size_t width = 800, size_t height = 600) :
-        ImageDevice(width, height), image((int)width, (int)height, QImage::Format_RGB32)
+        ImageDevice(width, height)
     {
         reset(width, height);
     }
 
+    QImageDevice(const QImageDevice& other) = delete;
+    QImageDevice& operator = (const QImageDevice& other) = delete;
+
     Paint::RGBColor getPixel(ssize_t x, ssize_t y) const override {
         if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
             throw std::range_error("pixel out of canvas");
-        return qrgb_to_paint_color(image.pixel(x, y));
+        return qrgb_to_paint_color(row(y)[x]);
     }
 
     void setPixel(ssize_t x, ssize_t y, Paint::RGBColor color) override {
         if (x < 0 || y < 0 || x >= ssize_t(width) || y >= ssize_t(height))
             return;
-        image.setPixel(x, y, paint_color_to_qrgb(color));
+        row(y)[x] = paint_color_to_qrgb(color);
+    }
+
+    void getHSpan(ssize_t x, ssize_t y, size_t len, Paint::RGBColor *out) const override {
+        const QRgb *src = row(y) + x;
+        for (size_t i = 0; i < len; i++)
+            out[i] = qrgb_to_paint_color(src[i]);
+    }
+
+    void setHSpan(ssize_t x, ssize_t y, size_t len, Paint::RGBColor color) override {
+        if (y < 0 || size_t(y) >= height) return;
+        ssize_t x1 = std::max<ssize_t>(x, 0),
+                x2 = std::min<ssize_t>(x + len, width);
+        if (x1 < x2)
+            std::fill(row(y) + x1, row(y) + x2, paint_color_to_qrgb(color));
+    }
+
+    void setVSpan(ssize_t x, ssize_t y, size_t len, Paint::RGBColor color) override {
+        if (x < 0 || size_t(x) >= width) return;
+        ssize_t y1 = std::max<ssize_t>(y, 0),
+                y2 = std::min<ssize_t>(y + len, height);
+        QRgb qrgb = paint_color_to_qrgb(color);
+        for (ssize_t i = y1; i < y2; i++)
+            row(i)[x] = qrgb;
+    }
+
+    void blendPixel(ssize_t x, ssize_t y, Paint::RGBColor color, uint8_t alpha) override {
+        if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+            return;
+        QRgb& pixel = row(y)[x];
+        pixel = paint_color_to_qrgb(Paint::blend(qrgb_to_paint_color(pixel), color, alpha));
+    }
+
+    void clear(Paint::RGBColor color) override {
+        image.fill(paint_color_to_qrgb(color));
+        attach();
+    }
+
+    // Takes over the pixels and the size of another image, such as one
+    // rendered on another thread.
+    void assign(const QImage& from) {
+        ImageDevice::reset(from.width(), from.height());
+        image = from;
+        attach();
+    }
+
+    // Copies rect from another image of the same size, such as a cached
+    // background layer.
+    void restore(const QImage& from, const QRect& rect) {
+        QRect r = rect & image.rect();
+        for (int y = r.top(); y <= r.bottom(); y++)
+            std::copy_n(reinterpret_cast<const QRgb*>(from.constScanLine(y)) + r.left(),
+                        r.width(), row(y) + r.left());
+    }
+
+    // Copies all of another image to the part of this one at offset.
+    void paste(const QImage& from, const QPoint& offset) {
+        QRect r = from.rect().translated(offset) & image.rect();
+        for (int y = r.top(); y <= r.bottom(); y++)
+            std::copy_n(reinterpret_cast<const QRgb*>(from.constScanLine(y - offset.y())) +
+                        (r.left() - offset.x()), r.width(), row(y) + r.left());
     }
 
     void reset(size_t width, size_t height) override {
         Paint::ImageDevice::reset(width, height);
         image = QImage(width, height, QImage::Format_RGB32);
-        image.fill(paint_color_to_qrgb(Paint::Colors::white));
+        clear(Paint::Colors::white);
     }
 
-    QPixmap getPixmap() {
-        QPixmap pixmap;
-        pixmap.convertFromImage(image);
-        return pixmap;
+    ~QImageDevice() override = default;
+};
+
+// Forwards to another device and keeps the bounding rectangle of the
+// pixels written through it.
+class BoundsDevice : public Paint::ImageDevice
+{
+public:
+    explicit BoundsDevice(Paint::ImageDevice& target) :
+        ImageDevice(target.getWidth(), target.getHeight()), target(target) {}
+
+    QRect bounds() const { return rect; }
+
+    Paint::RGBColor getPixel(ssize_t x, ssize_t y) const override {
+        return target.getPixel(x, y);
     }
 
-    ~QImageDevice() override = default;
+    void setPixel(ssize_t x, ssize_t y, Paint::RGBColor color) override {
+        if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+            return;
+        target.setPixel(x, y, color);
+        rect |= QRect(x, y, 1, 1);
+    }
+
+    void getHSpan(ssize_t x, ssize_t y, size_t len, Paint::RGBColor *out) const override {
+        target.getHSpan(x, y, len, out);
+    }
+
+    void setHSpan(ssize_t x, ssize_t y, size_t len, Paint::RGBColor color) override {
+        if (y < 0 || size_t(y) >= height) return;
+        ssize_t x1 = std::max<ssize_t>(x, 0),
+                x2 = std::min<ssize_t>(x + len, width);
+        if (x1 >= x2) return;
+        target.setHSpan(x1, y, x2 - x1, color);
+        rect |= QRect(x1, y, x2 - x1, 1);
+    }
+
+    void setVSpan(ssize_t x, ssize_t y, size_t len, Paint::RGBColor color) override {
+        if (x < 0 || size_t(x) >= width) return;
+        ssize_t y1 = std::max<ssize_t>(y, 0),
+                y2 = std::min<ssize_t>(y + len, height);
+        if (y1 >= y2) return;
+        target.setVSpan(x, y1, y2 - y1, color);
+        rect |= QRect(x, y1, 1, y2 - y1);
+    }
+
+    void blendPixel(ssize_t x, ssize_t y, Paint::RGBColor color, uint8_t alpha) override {
+        if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+            return;
+        target.blendPixel(x, y, color, alpha);
+        rect |= QRect(x, y, 1, 1);
+    }
+
+    void clear(Paint::RGBColor color) override {
+        target.clear(color);
+        rect = QRect(0, 0, width, height);
+    }
+
+private:
+    Paint::ImageDevice& target;
+    QRect rect;
 };
 
 #endif // QIMAGEDEVICE_H
@@ -6,25 +6,39 @@
 #include <QInputDialog>
 #include <QLayout>
 #include <QColorDialog>
-#include <QTextStream>
 #include <QDesktopServices>
 #include <QFileDialog>
+#include <QScrollBar>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+constexpr float MainWindow::MIN_ZOOM, MainWindow::MAX_ZOOM;
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
-    ui->label->setMouseTracking(true);
-    ui->label->resize(canvas.getWidth(), canvas.getHeight());
+    ui->canvasWidget->setMouseTracking(true);
+    canvas_size = QSize(canvas.getWidth(), canvas.getHeight());
+    resizeCanvasWidget();
     ui->splitter->setStretchFactor(0, 2);
-    ui->scrollAreaWidgetContents->setMinimumSize(canvas.getWidth(), canvas.getHeight());
-    connect(ui->label, &MovableLabel::mouseMoved, this, &MainWindow::canvasMouseMoved);
-    connect(ui->label, &MovableLabel::mouseClicked, this, &MainWindow::canvasMouseClicked);
-    connect(ui->label, &MovableLabel::mouseRightClicked, this, &MainWindow::canvasMouseRightClicked);
+    connect(ui->canvasWidget, &CanvasWidget::mouseMoved, this, &MainWindow::canvasMouseMoved);
+    connect(ui->canvasWidget, &CanvasWidget::mouseClicked, this, &MainWindow::canvasMouseClicked);
+    connect(ui->canvasWidget, &CanvasWidget::mouseRightClicked, this, &MainWindow::canvasMouseRightClicked);
+    connect(ui->canvasWidget, &CanvasWidget::zoomed, this, &MainWindow::canvasZoomed);
+    connect(ui->canvasWidget, &CanvasWidget::exposed, this, &MainWindow::viewChanged);
     setColor(Paint::Colors::black);
     ui->primitiveList->setEditTriggers(QAbstractItemView::NoEditTriggers);
     ui->primitiveList->setModel(&model);
+    refresh_timer.setSingleShot(true);
+    refresh_timer.setTimerType(Qt::PreciseTimer);
+    connect(&refresh_timer, &QTimer::timeout, this, &MainWindow::refresh);
+    connect(&renderer, &RenderThread::rendered, this, &MainWindow::rendered);
+    renderer.start();
+    refresh_label = new QLabel(this);
+    ui->statusBar->addPermanentWidget(refresh_label);
     render();
 }
 
@@ -33,20 +47,190 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+// Hands copies of the primitives of the canvas to the render thread, but
+// for the given one if any, to be rendered for the current view; the result
+// arrives in rendered().
+void MainWindow::requestRender(const Paint::Primitive *except)
+{
+    requestRender(except, view);
+}
+
+// Same, for only the given area of the view. The request cancels one that
+// is still being rendered, so it takes over its area too.
+void MainWindow::requestRender(const Paint::Primitive *except, QRect area)
+{
+    if (rendering) area |= requested_area;
+    area &= view;
+    std::map<int, std::unique_ptr<Paint::Primitive>> primitives;
+    for (auto& pr : canvas.primitives)
+        if (pr.second.get() != except)
+            primitives.emplace_hint(primitives.end(), pr.first, pr.second->clone());
+    requested = renderer.request(std::move(primitives), canvas_size.width(),
+                                 canvas_size.height(), area, zoom);
+    requested_except = except;
+    requested_area = area;
+    rendering = true;
+}
+
+// Renders again only the part of the view that damage covers. A fill
+// anywhere may spread into or out of it, so the whole view is rendered
+// if the canvas has any.
+void MainWindow::repaintDamage(const Damage& damage)
+{
+    bool all = damage.all;
+    for (auto& ps : canvas.primitives)
+        if (ps.second->type() == Paint::Primitive::Type::Fill) all = true;
+    if (all) {
+        render();
+        return;
+    }
+    QRectF scaled(damage.rect.topLeft() * zoom, damage.rect.bottomRight() * zoom);
+    // Strokes are at least a pixel wide in the view however far it is
+    // zoomed out, so the area takes a little more than the scaled box.
+    QRect area = scaled.toAlignedRect().adjusted(-2, -2, 2, 2) & view;
+    if (!area.isEmpty())
+        requestRender(nullptr, area);
+}
+
+// The canvas widget spans the whole canvas at the current zoom, though
+// only the visible part of it is ever rendered.
+void MainWindow::resizeCanvasWidget()
+{
+    QSize size(int(std::ceil(canvas_size.width() * zoom)), int(std::ceil(canvas_size.height() * zoom)));
+    ui->canvasWidget->resize(size);
+    ui->scrollAreaWidgetContents->setMinimumSize(size);
+}
+
+// Renders the visible part of the canvas widget whenever it is not the
+// view rendered last, such as after scrolling or resizing the window.
+void MainWindow::viewChanged()
+{
+    QRect visible = ui->canvasWidget->visibleRegion().boundingRect();
+    if (visible == view) return;
+    view = visible;
+    background = QImage();
+    background_except = nullptr;
+    requested_except = nullptr;
+    renderPreview();
+}
+
+// Zooms about the cursor, keeping the canvas pixel under it in place.
+void MainWindow::canvasZoomed(int delta, int x, int y)
+{
+    float next = zoom * std::pow(ZOOM_STEP, delta / 120.0f);
+    next = std::min(std::max(next, MIN_ZOOM), MAX_ZOOM);
+    if (next == zoom) return;
+    int dx = std::lround(x / zoom * next) - x, dy = std::lround(y / zoom * next) - y;
+    zoom = next;
+    resizeCanvasWidget();
+    QScrollBar *h = ui->scrollArea->horizontalScrollBar(), *v = ui->scrollArea->verticalScrollBar();
+    h->setValue(h->value() + dx);
+    v->setValue(v->value() + dy);
+    ui->canvasWidget->discard();
+    view = QRect();
+    viewChanged();
+}
+
+QPoint MainWindow::toCanvas(int x, int y) const
+{
+    return QPoint(int(std::floor(x / zoom)), int(std::floor(y / zoom)));
+}
+
+Paint::PointF MainWindow::viewOrigin() const
+{
+    return Paint::PointF(view.x() / zoom, view.y() / zoom);
+}
+
 void MainWindow::render()
 {
-    canvas.clear(Paint::Colors::white);
-    canvas.paint();
-    ui->label->setPixmap(canvas.getPixmap());
+    refresh_timer.stop();
+    frame_clock.restart();
+    background = QImage();
+    background_except = nullptr;
+    requestRender(nullptr);
 
     // ui->primitiveList->setModel(&model);
 }
 
-void MainWindow::updateList() {
-    QStringList list;
-    for (auto& pr : canvas.primitives)
-        list << (std::to_string(pr.first) + " " + pr.second->to_string()).c_str();
-    model.setStringList(list);
+// The image of the latest request replaces the canvas. Results of earlier
+// requests, which the render thread had no time to cancel, are dropped.
+void MainWindow::rendered(QImage image, unsigned generation)
+{
+    if (generation != requested) return;
+    rendering = false;
+    if (requested_area != view) {
+        canvas.paste(image, requested_area.topLeft() - view.topLeft());
+        ui->canvasWidget->present(canvas.image, view.topLeft(),
+                                  requested_area.translated(-view.topLeft()));
+        return;
+    }
+    canvas.assign(image);
+    if (!requested_except) {
+        ui->canvasWidget->present(canvas.image, view.topLeft());
+        return;
+    }
+    background = image;
+    background_except = requested_except;
+    overlay = canvas.image.rect();
+    renderPreview();
+}
+
+// Repaints only the primitive the current command is editing, over a cached
+// background holding all the others, which the render thread paints once
+// per command and view; until it arrives the previous frame stays on
+// screen. The edited primitive is drawn on top, from a copy moved into the
+// view, until the command finishes and render() restores the order of the
+// primitives.
+void MainWindow::renderPreview()
+{
+    Paint::Primitive *primitive = current_command ? current_command->preview() : nullptr;
+    if (!primitive) {
+        render();
+        return;
+    }
+    if (background.isNull() || background_except != primitive) {
+        if (requested_except != primitive)
+            requestRender(primitive);
+        return;
+    }
+    QRect changed = overlay;
+    canvas.restore(background, overlay);
+    BoundsDevice bounds(canvas);
+    std::unique_ptr<Paint::Primitive> shown = primitive->clone();
+    shown->to_view(viewOrigin(), zoom);
+    try {
+        shown->paint(bounds);
+    } catch (std::range_error&) {
+        // Out of range once magnified; the frame goes without the preview.
+    }
+    overlay = bounds.bounds();
+    ui->canvasWidget->present(canvas.image, view.topLeft(), changed | overlay);
+}
+
+// Mouse events may arrive much faster than frames can be shown, so previews
+// are drawn at most once every FRAME_INTERVAL ms. Refreshes requested while
+// one is pending are merged into it, and it renders the latest state of
+// the command when it runs.
+void MainWindow::scheduleRefresh()
+{
+    if (refresh_timer.isActive()) {
+        merged_refreshes++;
+        refresh_label->setText(tr("%1 refreshes merged").arg(merged_refreshes));
+        return;
+    }
+    refresh_timer.start(std::max<qint64>(0, FRAME_INTERVAL - frame_clock.elapsed()));
+}
+
+void MainWindow::refresh()
+{
+    frame_clock.restart();
+    renderPreview();
+}
+
+// The rows of the primitive list follow the canvas; changed was edited in
+// place.
+void MainWindow::updateList(const Paint::Primitive *changed) {
+    model.sync(changed);
 }
 
 void MainWindow::on_actionAbout_Paint_triggered()
@@ -84,16 +268,19 @@ void MainWindow::command_status_handler(Command::status status)
         updateList();
         ui->statusBar->showMessage("Aborted.");
         break;
-    case Command::DONE :
+    case Command::DONE : {
+        const Paint::Primitive *edited = current_command ? current_command->preview() : nullptr;
+        if (current_command) history.record(current_command->edit());
         current_command = nullptr;
         render();
-        updateList();
+        updateList(edited);
         ui->statusBar->showMessage("Done.");
         break;
+    }
     case Command::CONTINUE :
         break;
     case Command::REFRESH :
-        render();
+        scheduleRefresh();
         break;
     }
 }
@@ -101,65 +288,90 @@ void MainWindow::command_status_handler(Command::status status)
 void MainWindow::canvasMouseMoved(int x, int y)
 {
     // ui->label->setText(tr("(%1, %2)").arg(x).arg(y));
+    QPoint at = toCanvas(x, y);
     if (current_command)
-        command_status_handler(current_command->mouseMove(x, y));
+        command_status_handler(current_command->mouseMove(at.x(), at.y()));
 }
 
 void MainWindow::canvasMouseClicked(int x, int y)
 {
     // this->setWindowTitle(tr("clicked (%1, %2)").arg(x).arg(y));
+    QPoint at = toCanvas(x, y);
     if (current_command)
-        command_status_handler(current_command->mouseClick(x, y));
+        command_status_handler(current_command->mouseClick(at.x(), at.y()));
 }
 
 void MainWindow::canvasMouseRightClicked(int x, int y)
 {
     // this->setWindowTitle(tr("right clicked (%1, %2)").arg(x).arg(y));
+    QPoint at = toCanvas(x, y);
     if (current_command)
-        command_status_handler(current_command->mouseRightClick(x, y));
+        command_status_handler(current_command->mouseRightClick(at.x(), at.y()));
 }
 
 void MainWindow::on_cmdResize_clicked()
 {
     bool ok;
-    int width = QInputDialog::getInt(this, "Resize", "Please specify width of the canvas:", 800, 100, 1200, 100, &ok);
+    int width = QInputDialog::getInt(this, "Resize", "Please specify width of the canvas:", 800, 100, MAX_CANVAS_SIZE, 100, &ok);
     if (!ok) return;
-    int height = QInputDialog::getInt(this, "Resize", "Please specify height of the canvas:", 600, 100, 1200, 100, &ok);
+    int height = QInputDialog::getInt(this, "Resize", "Please specify height of the canvas:", 600, 100, MAX_CANVAS_SIZE, 100, &ok);
     if (!ok) return;
-    ui->label->resize(width, height);
-    ui->scrollAreaWidgetContents->setMinimumSize(width, height);
-    canvas.reset(width, height);
-    render();
+    canvas_size = QSize(width, height);
+    resizeCanvasWidget();
+    ui->canvasWidget->discard();
+    view = QRect();
+    viewChanged();
 }
 
 void MainWindow::on_cmdLine_clicked()
 {
     if (current_command) command_status_handler(current_command->abort());
     current_command.reset(new LineCommand(canvas, color, line_drawing_algo, ui->statusBar));
+    styleNewPrimitive();
 }
 
 void MainWindow::on_cmdPolygon_clicked()
 {
     if (current_command) command_status_handler(current_command->abort());
     current_command.reset(new PolygonCommand(canvas, color, line_drawing_algo, ui->statusBar));
+    styleNewPrimitive();
 }
 
 void MainWindow::on_cmdEllipse_clicked()
 {
     if (current_command) command_status_handler(current_command->abort());
     current_command.reset(new EllipseCommand(canvas, color, ui->statusBar));
+    styleNewPrimitive();
 }
 
 void MainWindow::on_cmdBezier_clicked()
 {
     if (current_command) command_status_handler(current_command->abort());
     current_command.reset(new BezierCommand(canvas, color, ui->statusBar));
+    styleNewPrimitive();
 }
 
 void MainWindow::on_cmdBSpline_clicked()
 {
     if (current_command) command_status_handler(current_command->abort());
     current_command.reset(new BSplineCommand(canvas, color, ui->statusBar));
+    styleNewPrimitive();
+}
+
+void MainWindow::on_cmdFill_clicked()
+{
+    if (current_command) command_status_handler(current_command->abort());
+    current_command.reset(new FillCommand(canvas, color, ui->statusBar));
+}
+
+// Drawing commands append their primitive to the canvas with the next free
+// id, so the last primitive is the one being drawn.
+void MainWindow::styleNewPrimitive()
+{
+    if (canvas.primitives.empty()) return;
+    Paint::Primitive& primitive = *canvas.primitives.rbegin()->second;
+    primitive.set_antialias(antialias);
+    primitive.set_stroke_width(stroke_width);
 }
 
 void MainWindow::setColor(Paint::RGBColor color)
@@ -179,12 +391,7 @@ void MainWindow::on_cmdChangeColor_clicked()
 }
 
 int MainWindow::getSeletectedPrimitiveIndex() {
-    int rid = ui->primitiveList->currentIndex().row(), eid;
-    if (rid < 0) return -1;
-    // QTextStream takes a mutable pointer to QString.
-    QString str(model.stringList().at(rid));
-    QTextStream ss(&str);
-    int id; ss >> id;
+    int id = model.id(ui->primitiveList->currentIndex());
     if (canvas.primitives.count(id) == 0) return -1;
     return id;
 }
@@ -232,7 +439,7 @@ void MainWindow::on_cmdClip_clicked()
     }
     try {
         Paint::Line &line = dynamic_cast<Paint::Line&>(*canvas.primitives[eid]);
-        current_command.reset(new ClipCommand(canvas, line, clip_algo, ui->statusBar));
+        current_command.reset(new ClipCommand(canvas, eid, line, clip_algo, ui->statusBar));
     } catch (std::bad_cast&) {
         QMessageBox::warning(this, "Paint", "Clip operation is applicable to line only!");
         return;
@@ -247,7 +454,10 @@ void MainWindow::on_cmdDelete_clicked()
         QMessageBox::warning(this, "Paint", "Please select exactly one primitive!");
         return;
     }
-    canvas.primitives.erase(eid);
+    std::unique_ptr<Edit> edit(new PresenceEdit(eid));
+    Damage damage;
+    edit->redo(canvas, damage);
+    history.record(std::move(edit));
     command_status_handler(Command::DONE);
 }
 
@@ -276,6 +486,11 @@ void MainWindow::on_actionB_Spline_triggered()
     on_cmdBSpline_clicked();
 }
 
+void MainWindow::on_actionFill_triggered()
+{
+    on_cmdFill_clicked();
+}
+
 void MainWindow::on_actionBezier_triggered()
 {
     on_cmdBezier_clicked();
@@ -309,7 +524,12 @@ void MainWindow::on_actionChange_Color_triggered()
 void MainWindow::on_actionSave_triggered()
 {
     QString filename = QFileDialog::getSaveFileName(this, "Save File");
-    canvas.image.save(filename);
+    // The canvas only holds the view, so the whole of it is painted anew.
+    QImageDevice device(canvas_size.width(), canvas_size.height());
+    device.clear(Paint::Colors::white);
+    for (auto& ps : canvas.primitives)
+        ps.second->paint(device);
+    device.image.save(filename);
 }
 
 void MainWindow::on_actionLine_Algorithm_toggled(bool arg1)
@@ -329,3 +549,35 @@ void MainWindow::on_actionClip_Algorithm_toggled(bool arg1)
         clip_algo = Paint::LineClippingAlgorithm::LiangBarsky;
     }
 }
+
+void MainWindow::on_actionAntialias_toggled(bool arg1)
+{
+    antialias = arg1;
+}
+
+void MainWindow::on_actionStroke_Width_triggered()
+{
+    bool ok;
+    double width = QInputDialog::getDouble(this, "Stroke Width", "Please specify the width of new shapes:",
+                                           stroke_width, 1, Paint::MAX_STROKE_WIDTH, 1, &ok);
+    if (ok) stroke_width = width;
+}
+
+// Undoing and redoing repaint only what the edit changed.
+void MainWindow::on_actionUndo_triggered()
+{
+    if (current_command) command_status_handler(current_command->abort());
+    Damage damage;
+    if (!history.undo(canvas, damage)) return;
+    updateList(damage.primitive);
+    repaintDamage(damage);
+}
+
+void MainWindow::on_actionRedo_triggered()
+{
+    if (current_command) command_status_handler(current_command->abort());
+    Damage damage;
+    if (!history.redo(canvas, damage)) return;
+    updateList(damage.primitive);
+    repaintDamage(damage);
+}
@@ -6,7 +6,11 @@
 #include <device.h>
 #include <memory>
 #include <command.h>
-#include <QStringListModel>
+#include <renderthread.h>
+#include <primitivelistmodel.h>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QLabel>
 #include "paint/canvas.h"
 
 namespace Ui {
@@ -21,6 +25,12 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow() override;
     void render();
+    void requestRender(const Paint::Primitive *except);
+    void requestRender(const Paint::Primitive *except, QRect area);
+    void repaintDamage(const Damage& damage);
+    void renderPreview();
+    void resizeCanvasWidget();
+    void scheduleRefresh();
 
 private slots:
     void on_actionAbout_Paint_triggered();
@@ -31,6 +41,10 @@ private slots:
 
     void canvasMouseRightClicked(int x, int y);
 
+    void canvasZoomed(int delta, int x, int y);
+
+    void viewChanged();
+
     void on_cmdResize_clicked();
 
     void on_cmdLine_clicked();
@@ -43,6 +57,8 @@ private slots:
 
     void on_cmdBSpline_clicked();
 
+    void on_cmdFill_clicked();
+
     void on_cmdChangeColor_clicked();
 
     void on_actionOfficial_Website_triggered();
@@ -67,6 +83,8 @@ private slots:
 
     void on_actionB_Spline_triggered();
 
+    void on_actionFill_triggered();
+
     void on_actionBezier_triggered();
 
     void on_actionMove_triggered();
@@ -85,20 +103,70 @@ private slots:
 
     void on_actionClip_Algorithm_toggled(bool arg1);
 
+    void on_actionAntialias_toggled(bool arg1);
+
+    void on_actionStroke_Width_triggered();
+
+    void on_actionUndo_triggered();
+
+    void on_actionRedo_triggered();
+
+    void refresh();
+
+    void rendered(QImage image, unsigned generation);
+
 private:
     void command_status_handler(Command::status status);
+    void styleNewPrimitive();
     void setColor(Paint::RGBColor color);
-    void updateList();
+    void updateList(const Paint::Primitive *changed = nullptr);
     int getSeletectedPrimitiveIndex();
+    QPoint toCanvas(int x, int y) const;
+    Paint::PointF viewOrigin() const;
 
     std::unique_ptr<Command> current_command;
     Ui::MainWindow *ui;
+    // The primitives, and as a device the view onto them; the size of the
+    // canvas is kept apart.
     Paint::Canvas<QImageDevice> canvas;
+    QSize canvas_size;
     Paint::RGBColor color;
-    QStringListModel model;
+    PrimitiveListModel model{canvas.primitives};
+
+    // All primitives but the one being previewed, as painted by the render
+    // thread, and the area of the canvas the preview covers.
+    QImage background;
+    const Paint::Primitive *background_except = nullptr;
+    QRect overlay;
+
+    // The part of the canvas widget that is visible and rendered, and the
+    // zoom it is shown at.
+    static constexpr int MAX_CANVAS_SIZE = 16384;
+    static constexpr float MIN_ZOOM = 1.0f / 16, MAX_ZOOM = 16.0f, ZOOM_STEP = 1.25f;
+    QRect view;
+    float zoom = 1.0f;
+
+    RenderThread renderer;
+    // The latest render request, the primitive it leaves out and the part
+    // of the view it covers, and whether its result is still to come.
+    unsigned requested = 0;
+    const Paint::Primitive *requested_except = nullptr;
+    QRect requested_area;
+    bool rendering = false;
+
+    History history;
+
+    // Minimum time between two previews, in milliseconds.
+    static constexpr int FRAME_INTERVAL = 16;
+    QTimer refresh_timer;
+    QElapsedTimer frame_clock;
+    unsigned long merged_refreshes = 0;
+    QLabel *refresh_label;
 
     Paint::Line::Algorithm line_drawing_algo = Paint::Line::Algorithm::Bresenham;
     Paint::LineClippingAlgorithm clip_algo = Paint::LineClippingAlgorithm::LiangBarsky;
+    bool antialias = false;
+    float stroke_width = 1.0f;
 };
 
 #endif // MAINWINDOW_H
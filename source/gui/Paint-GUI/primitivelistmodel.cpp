@@ -0,0 +1,58 @@
+#include "primitivelistmodel.h"
+
+int PrimitiveListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : int(rows.size());
+}
+
+QVariant PrimitiveListModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole) return QVariant();
+    int eid = id(index);
+    auto it = primitives.find(eid);
+    if (it == primitives.end()) return QVariant();
+    return QString::fromStdString(std::to_string(eid) + " " + it->second->to_string());
+}
+
+int PrimitiveListModel::id(const QModelIndex& index) const
+{
+    if (!index.isValid() || index.row() >= int(rows.size())) return -1;
+    return rows[index.row()].id;
+}
+
+// Both the rows and the map are sorted by id, so one pass over the two
+// finds each run of ids that is only in one of them.
+void PrimitiveListModel::sync(const Paint::Primitive *changed)
+{
+    size_t row = 0;
+    auto it = primitives.begin();
+    auto only_in_rows = [&] (size_t r) {
+        return r < rows.size() && (it == primitives.end() || rows[r].id < it->first);
+    };
+    while (row < rows.size() || it != primitives.end()) {
+        if (only_in_rows(row)) {
+            size_t last = row + 1;
+            while (only_in_rows(last)) last++;
+            beginRemoveRows(QModelIndex(), int(row), int(last - 1));
+            rows.erase(rows.begin() + row, rows.begin() + last);
+            endRemoveRows();
+        } else if (row == rows.size() || it->first < rows[row].id) {
+            std::vector<Row> added;
+            for (; it != primitives.end() && (row == rows.size() || it->first < rows[row].id); ++it)
+                added.push_back({ it->first, it->second.get() });
+            beginInsertRows(QModelIndex(), int(row), int(row + added.size() - 1));
+            rows.insert(rows.begin() + row, added.begin(), added.end());
+            endInsertRows();
+            row += added.size();
+        } else {
+            const Paint::Primitive *primitive = it->second.get();
+            if (rows[row].primitive != primitive || primitive == changed) {
+                rows[row].primitive = primitive;
+                QModelIndex at = index(int(row));
+                emit dataChanged(at, at);
+            }
+            ++row;
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef PRIMITIVELISTMODEL_H
+#define PRIMITIVELISTMODEL_H
+
+#include <vector>
+#include <QAbstractListModel>
+#include "paint/snapshot.h"
+
+// Lists the primitives of a canvas in the order of their ids, straight from
+// the map that holds them; the text of a row is only made when a view asks
+// for it. Commands edit the map directly, so sync() is called after each
+// one to tell the views which rows came, went or changed.
+class PrimitiveListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit PrimitiveListModel(const Paint::PrimitiveMap& primitives, QObject *parent = nullptr) :
+        QAbstractListModel(parent), primitives(primitives) {}
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    // The id of the primitive in the row of index, or -1 if there is none.
+    int id(const QModelIndex& index) const;
+
+    // Brings the rows in line with the map, inserting and removing only
+    // the rows whose ids were added or erased. Rows whose id now holds
+    // another primitive, and the row of changed if given, are reported as
+    // changed.
+    void sync(const Paint::Primitive *changed = nullptr);
+
+private:
+    struct Row {
+        int id;
+        const Paint::Primitive *primitive;
+    };
+
+    const Paint::PrimitiveMap& primitives;
+    std::vector<Row> rows;
+};
+
+#endif // PRIMITIVELISTMODEL_H
@@ -0,0 +1,110 @@
+#include "renderthread.h"
+#include "device.h"
+#include "paint/canvas.h"
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <QMutexLocker>
+
+RenderThread::~RenderThread()
+{
+    {
+        QMutexLocker lock(&mutex);
+        quitting = true;
+        generation++;
+        wake.wakeOne();
+    }
+    wait();
+}
+
+// The part of image magnified by zoom that lies within view, each pixel
+// taking the color of the image pixel under it. The rest is white.
+static QImage crop_view(const QImage& image, QRect view, float zoom)
+{
+    QImage out(view.width(), view.height(), QImage::Format_RGB32);
+    std::vector<int> column(view.width());
+    for (int x = 0; x < view.width(); x++)
+        column[x] = int(std::floor((view.x() + x) / zoom));
+    for (int y = 0; y < view.height(); y++) {
+        QRgb *dst = reinterpret_cast<QRgb*>(out.scanLine(y));
+        int sy = int(std::floor((view.y() + y) / zoom));
+        const QRgb *src = sy >= 0 && sy < image.height() ?
+            reinterpret_cast<const QRgb*>(image.constScanLine(sy)) : nullptr;
+        for (int x = 0; x < view.width(); x++)
+            dst[x] = src && column[x] >= 0 && column[x] < image.width() ?
+                src[column[x]] : qRgb(255, 255, 255);
+    }
+    return out;
+}
+
+unsigned RenderThread::request(std::map<int, std::unique_ptr<Paint::Primitive>> primitives,
+                               size_t width, size_t height, QRect view, float zoom)
+{
+    QMutexLocker lock(&mutex);
+    pending.swap(primitives);
+    pending_width = width;
+    pending_height = height;
+    pending_view = view;
+    pending_zoom = zoom;
+    has_pending = true;
+    wake.wakeOne();
+    return ++generation;
+}
+
+void RenderThread::run()
+{
+    Paint::Canvas<QImageDevice> canvas;
+    for (;;) {
+        std::map<int, std::unique_ptr<Paint::Primitive>> primitives;
+        size_t width, height;
+        QRect view;
+        float zoom;
+        unsigned job;
+        {
+            QMutexLocker lock(&mutex);
+            while (!has_pending && !quitting)
+                wake.wait(&mutex);
+            if (quitting) return;
+            primitives.swap(pending);
+            width = pending_width;
+            height = pending_height;
+            view = pending_view;
+            zoom = pending_zoom;
+            job = generation;
+            has_pending = false;
+        }
+        if (view.isEmpty()) continue;
+        // The primitives of the previous request go with primitives.
+        canvas.primitives.swap(primitives);
+        // A fill spreads over its whole region, wherever its seed is, so a
+        // canvas with fills is rendered at its own size, as it is saved,
+        // and the view cut out of it.
+        bool whole = false;
+        for (auto& ps : canvas.primitives)
+            if (ps.second->type() == Paint::Primitive::Type::Fill) whole = true;
+        size_t canvas_width = width, canvas_height = height;
+        if (!whole) {
+            // Only the view is rasterized, from primitives moved into its
+            // coordinates; those that end up off it are culled by paint.
+            Paint::PointF origin(view.x() / zoom, view.y() / zoom);
+            for (auto& ps : canvas.primitives)
+                ps.second->to_view(origin, zoom);
+            canvas_width = view.width();
+            canvas_height = view.height();
+        }
+        if (canvas.getWidth() != canvas_width || canvas.getHeight() != canvas_height)
+            canvas.reset(canvas_width, canvas_height);
+        canvas.clear(Paint::Colors::white);
+        // A primitive that crosses the view may still reach past the range
+        // of coordinates once magnified, which its rasterizer rejects; the
+        // frame is then dropped rather than the error ending the thread.
+        bool painted;
+        try {
+            painted = canvas.paint(nullptr, [&] { return generation != job; });
+        } catch (std::range_error&) {
+            continue;
+        }
+        if (painted)
+            emit rendered(whole ? crop_view(canvas.image, view, zoom) : canvas.image, job);
+    }
+}
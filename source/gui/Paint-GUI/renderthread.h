@@ -0,0 +1,49 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include "paint/canvas.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QImage>
+#include <QRect>
+
+// Renders copies of the primitives of the canvas off the event thread. Only the latest request matters: a newer one cancels the render
+// in progress at its next primitive, and the results of cancelled renders
+// are never delivered.
+class RenderThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit RenderThread(QObject *parent = nullptr) : QThread(parent) {}
+    ~RenderThread() override;
+
+    // Renders primitives, which the thread takes over, on a canvas of the
+    // given size as seen through view: the part of the canvas magnified by
+    // zoom that lies within view. Returns the number of the request, which
+    // comes back with its result.
+    unsigned request(std::map<int, std::unique_ptr<Paint::Primitive>> primitives,
+                     size_t width, size_t height, QRect view, float zoom);
+
+signals:
+    void rendered(QImage image, unsigned generation);
+
+protected:
+    void run() override;
+
+private:
+    QMutex mutex;
+    QWaitCondition wake;
+    std::map<int, std::unique_ptr<Paint::Primitive>> pending;
+    size_t pending_width = 0, pending_height = 0;
+    QRect pending_view;
+    float pending_zoom = 1.0f;
+    bool has_pending = false, quitting = false;
+    std::atomic<unsigned> generation{0};
+};
+
+#endif // RENDERTHREAD_H
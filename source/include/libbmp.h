@@ -24,6 +24,7 @@
 #include <string>
 #include <cstdint>
 #include <stdexcept>
+#include <functional>
 #include <paint/paint.h>
 #include <paint/device.h>
 
@@ -42,6 +43,29 @@ namespace LibBmp {
         BMP_OK = 0
     };
 
+    //
+    // BmpHeader
+    //
+
+    // Use a struct to read this in one call
+    struct BmpHeader
+    {
+        unsigned int bfSize = 0;
+        unsigned int bfReserved = 0;
+        unsigned int bfOffBits = 54;
+        unsigned int biSize = 40;
+        int biWidth = 0;
+        int biHeight = 0;
+        unsigned short biPlanes = 1;
+        unsigned short biBitCount = 24;
+        unsigned int biCompression = 0;
+        unsigned int biSizeImage = 0;
+        int biXPelsPerMeter = 0;
+        int biYPelsPerMeter = 0;
+        unsigned int biClrUsed = 0;
+        unsigned int biClrImportant = 0;
+    };
+
     //
     // BmpPixbuf
     //
@@ -101,26 +125,23 @@ namespace LibBmp {
             int get_width (void) const;
             int get_height (void) const;
         private:
-            // Use a struct to read this in one call
-            struct
-            {
-            unsigned int bfSize = 0;
-            unsigned int bfReserved = 0;
-            unsigned int bfOffBits = 54;
-            unsigned int biSize = 40;
-            int biWidth = 0;
-            int biHeight = 0;
-            unsigned short biPlanes = 1;
-            unsigned short biBitCount = 24;
-            unsigned int biCompression = 0;
-            unsigned int biSizeImage = 0;
-            int biXPelsPerMeter = 0;
-            int biYPelsPerMeter = 0;
-            unsigned int biClrUsed = 0;
-            unsigned int biClrImportant = 0;
-            } header;
+            BmpHeader header;
     };
     
+    // The magic and header that start a 24-bit bottom-up bitmap of the
+    // given size, as write_rows writes them. Rows of 3 * width bytes,
+    // each padded to a multiple of 4, follow from the bottom up.
+    std::string encode_header (const int width,
+                               const int height);
+
+    // Writes a bottom-up bitmap without holding the image in memory:
+    // fill_row (y, row) is called for every row from the bottom up and
+    // stores its pixels in BGR order.
+    enum BmpError write_rows (const std::string& filename,
+                              const int width,
+                              const int height,
+                              const std::function<void (int, unsigned char*)>& fill_row);
+
     class BmpDevice : public Paint::ImageDevice {
     private: 
         BmpImg bmpimg;
@@ -145,6 +166,32 @@ namespace LibBmp {
                 return;
             bmpimg.set_pixel(x, y, color.red, color.green, color.blue); 
         }
+
+        void getHSpan(ssize_t x, ssize_t y, std::size_t len,
+                      Paint::RGBColor *out) const override {
+            for (std::size_t i = 0; i < len; i++)
+                out[i] = Paint::RGBColor(bmpimg.red_at(x + i, y),
+                                         bmpimg.green_at(x + i, y),
+                                         bmpimg.blue_at(x + i, y));
+        }
+
+        void setHSpan(ssize_t x, ssize_t y, std::size_t len,
+                      Paint::RGBColor color) override {
+            if (y < 0 || std::size_t(y) >= height) return;
+            ssize_t x1 = std::max<ssize_t>(x, 0),
+                    x2 = std::min<ssize_t>(x + len, width);
+            for (ssize_t i = x1; i < x2; i++)
+                bmpimg.set_pixel(i, y, color.red, color.green, color.blue);
+        }
+
+        void setVSpan(ssize_t x, ssize_t y, std::size_t len,
+                      Paint::RGBColor color) override {
+            if (x < 0 || std::size_t(x) >= width) return;
+            ssize_t y1 = std::max<ssize_t>(y, 0),
+                    y2 = std::min<ssize_t>(y + len, height);
+            for (ssize_t i = y1; i < y2; i++)
+                bmpimg.set_pixel(x, i, color.red, color.green, color.blue);
+        }
         
         void reset(std::size_t width, std::size_t height) override {
             Paint::ImageDevice::reset(width, height);
@@ -157,6 +204,30 @@ namespace LibBmp {
         }
     };
 
+    // A tiled device for large canvases. Rows are assembled one at a time
+    // when saving, with tiles that were never drawn on read as the clear
+    // color.
+    class TiledBmpDevice : public Paint::TiledImageDevice {
+    public:
+        explicit TiledBmpDevice(std::size_t width = 800, std::size_t height = 600) :
+            Paint::TiledImageDevice(width, height) { }
+
+        void save(const std::string& filename) const {
+            std::vector<Paint::RGBColor> span(width);
+            BmpError err = write_rows(filename, width, height,
+                [&] (int y, unsigned char *row) {
+                    getHSpan(0, y, width, span.data());
+                    for (Paint::RGBColor color : span) {
+                        *row++ = color.blue;
+                        *row++ = color.green;
+                        *row++ = color.red;
+                    }
+                });
+            if (static_cast<int>(err) < 0)
+                throw std::runtime_error("cannot save to '" + filename + "'");
+        }
+    };
+
 }
 
 #endif /* __LIBBMP_H__ */
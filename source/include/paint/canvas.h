@@ -22,9 +22,11 @@
 #include <map>
 #include <type_traits>
 #include <memory>
+#include <vector>
 
 #include <paint/paint.h>
 #include <paint/primitive.h>
+#include <paint/snapshot.h>
 
 namespace Paint {
 
@@ -35,10 +37,43 @@ namespace Paint {
 
     public:
         std::map<int, std::unique_ptr<Primitive>> primitives;
+        // Shapes that instances can be made of, by id. Removing a shape
+        // leaves its instances intact.
+        ShapeMap shapes;
 
-        void paint() {
-            for (auto& ps : primitives)
-                ps.second->paint(static_cast<DeviceT&>(*this));
+        // Paints every primitive but except, if given.
+        void paint(const Primitive *except = nullptr) {
+            paint(except, [] { return false; });
+        }
+
+        // Same, but gives up as soon as cancelled() returns true; it is
+        // polled between primitives. Returns whether painting finished.
+        // Primitives whose bounds lie off the device are skipped.
+        template <typename CancelT>
+        bool paint(const Primitive *except, CancelT&& cancelled) {
+            DeviceT& device = static_cast<DeviceT&>(*this);
+            float width = this->getWidth(), height = this->getHeight();
+            // Runs of consecutive lines are handed to the batched rasterizer.
+            std::vector<Line*> lines;
+            for (auto& ps : primitives) {
+                if (ps.second.get() == except) continue;
+                PointF min, max;
+                if (ps.second->bounds(min, max) &&
+                    !(max.x >= 0 && max.y >= 0 && min.x < width && min.y < height))
+                    continue;
+                if (ps.second->type() == Primitive::Type::Line) {
+                    lines.push_back(static_cast<Line*>(ps.second.get()));
+                    continue;
+                }
+                if (cancelled()) return false;
+                Line::paint_batch(device, lines.data(), lines.size());
+                lines.clear();
+                if (cancelled()) return false;
+                ps.second->paint(device);
+            }
+            if (cancelled()) return false;
+            Line::paint_batch(device, lines.data(), lines.size());
+            return true;
         }
 
         template <typename T>
@@ -48,9 +83,26 @@ namespace Paint {
             return id;
         }
 
+        // Returns false if id is taken, in which case prototype is deleted.
+        bool add_shape(Primitive* prototype, int id) {
+            std::shared_ptr<const Shape> shape = std::make_shared<const Shape>(prototype);
+            return shapes.emplace(id, std::move(shape)).second;
+        }
+
         Primitive& operator[] (int id) {
             return *primitives[id];
         }
+
+        void save_snapshot(const std::string& filename) {
+            Paint::save_snapshot(filename, this->getWidth(), this->getHeight(),
+                                 primitives, shapes);
+        }
+
+        void load_snapshot(const std::string& filename) {
+            size_t width, height;
+            Paint::load_snapshot(filename, width, height, primitives, shapes);
+            this->reset(width, height);
+        }
     };
 }
 
@@ -19,6 +19,9 @@
 #ifndef __DEVICE_H__
 #define __DEVICE_H__
 
+#include <cstddef>
+#include <memory>
+
 namespace Paint {
     class ImageDevice {
     protected:
@@ -27,8 +30,8 @@ namespace Paint {
             width(width), height(height) { }
 
     public:
-        size_t getWidth() { return width; }
-        size_t getHeight() { return height; }
+        size_t getWidth() const { return width; }
+        size_t getHeight() const { return height; }
         virtual RGBColor getPixel(ssize_t x, ssize_t y) const = 0;
         RGBColor getPixel(PointI pt) const {
             return getPixel(pt.x, pt.y);
@@ -37,6 +40,29 @@ namespace Paint {
         void setPixel(PointI pt, RGBColor color) {
             setPixel(pt.x, pt.y, color);
         }
+        // Reads len pixels of row y starting from x into out. The span must
+        // lie inside the device.
+        virtual void getHSpan(ssize_t x, ssize_t y, size_t len, RGBColor *out) const {
+            for (size_t i = 0; i < len; i++)
+                out[i] = getPixel(x + i, y);
+        }
+        // Set len pixels in a row (HSpan) or column (VSpan) starting from
+        // (x, y). Pixels outside the device are skipped.
+        virtual void setHSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) {
+            for (size_t i = 0; i < len; i++)
+                setPixel(x + i, y, color);
+        }
+        virtual void setVSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) {
+            for (size_t i = 0; i < len; i++)
+                setPixel(x, y + i, color);
+        }
+        // Blends color over the pixel at (x, y) with the given opacity
+        // (0 - 255). Pixels outside the device are skipped.
+        virtual void blendPixel(ssize_t x, ssize_t y, RGBColor color, uint8_t alpha) {
+            if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+                return;
+            setPixel(x, y, blend(getPixel(x, y), color, alpha));
+        }
         virtual void reset(size_t width, size_t height) {
             this->width = width;
             this->height = height;
@@ -81,6 +107,33 @@ namespace Paint {
             data[width * y + x] = color;
         }
 
+        void getHSpan(ssize_t x, ssize_t y, size_t len, RGBColor *out) const override {
+            std::copy_n(&data[width * y + x], len, out);
+        }
+
+        void setHSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) override {
+            if (y < 0 || size_t(y) >= height) return;
+            ssize_t x1 = std::max<ssize_t>(x, 0),
+                    x2 = std::min<ssize_t>(x + len, width);
+            if (x1 < x2)
+                std::fill(&data[width * y + x1], &data[width * y + x2], color);
+        }
+
+        void setVSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) override {
+            if (x < 0 || size_t(x) >= width) return;
+            ssize_t y1 = std::max<ssize_t>(y, 0),
+                    y2 = std::min<ssize_t>(y + len, height);
+            for (ssize_t i = y1; i < y2; i++)
+                data[width * i + x] = color;
+        }
+
+        void blendPixel(ssize_t x, ssize_t y, RGBColor color, uint8_t alpha) override {
+            if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+                return;
+            RGBColor& pixel = data[width * y + x];
+            pixel = blend(pixel, color, alpha);
+        }
+
         void clear(RGBColor color) override {
             std::fill(data.begin(), data.end(), color);
         }
@@ -90,6 +143,212 @@ namespace Paint {
             data.assign(width * height, RGBColor());
         }
     };
+
+    // Draws into pixels the caller owns: rows of width pixels, stride bytes
+    // apart, which is negative for bottom-up images. Each pixel takes
+    // layout.bytes bytes, with the channels at the given offsets and the
+    // alpha byte, if any, set to 255 on every write. Resetting the size
+    // detaches the device until the next attach().
+    class BufferImageDevice : public ImageDevice {
+    public:
+        struct Layout {
+            size_t bytes;
+            int red, green, blue, alpha;
+        };
+
+        explicit BufferImageDevice(size_t width = 800, size_t height = 600) :
+            ImageDevice(width, height) { }
+
+        BufferImageDevice(const BufferImageDevice& other) = delete;
+        BufferImageDevice& operator = (const BufferImageDevice& other) = delete;
+
+        void attach(uint8_t *pixels, ptrdiff_t stride, Layout layout) {
+            this->pixels = pixels;
+            this->stride = stride;
+            this->layout = layout;
+        }
+
+        RGBColor getPixel(ssize_t x, ssize_t y) const override {
+            if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+                throw std::range_error("pixel out of canvas");
+            const uint8_t *p = at(x, y);
+            return RGBColor(p[layout.red], p[layout.green], p[layout.blue]);
+        }
+
+        void setPixel(ssize_t x, ssize_t y, RGBColor color) override {
+            if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+                return;
+            put(at(x, y), color);
+        }
+
+        void getHSpan(ssize_t x, ssize_t y, size_t len, RGBColor *out) const override {
+            const uint8_t *p = at(x, y);
+            for (size_t i = 0; i < len; i++, p += layout.bytes)
+                out[i] = RGBColor(p[layout.red], p[layout.green], p[layout.blue]);
+        }
+
+        void setHSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) override {
+            if (y < 0 || size_t(y) >= height) return;
+            ssize_t x1 = std::max<ssize_t>(x, 0),
+                    x2 = std::min<ssize_t>(x + len, width);
+            for (uint8_t *p = at(x1, y); x1 < x2; x1++, p += layout.bytes)
+                put(p, color);
+        }
+
+        void clear(RGBColor color) override {
+            for (size_t y = 0; y < height; y++)
+                setHSpan(0, y, width, color);
+        }
+
+        void reset(size_t width, size_t height) override {
+            ImageDevice::reset(width, height);
+            pixels = nullptr;
+        }
+
+    private:
+        uint8_t *pixels = nullptr;
+        ptrdiff_t stride = 0;
+        Layout layout = { 3, 0, 1, 2, -1 };
+
+        uint8_t *at(ssize_t x, ssize_t y) const {
+            return pixels + stride * y + ptrdiff_t(layout.bytes) * x;
+        }
+
+        void put(uint8_t *p, RGBColor color) const {
+            p[layout.red] = color.red;
+            p[layout.green] = color.green;
+            p[layout.blue] = color.blue;
+            if (layout.alpha >= 0) p[layout.alpha] = 255;
+        }
+    };
+
+    // Keeps the image in TILE_SIZE x TILE_SIZE tiles that are allocated on
+    // the first write of a color other than the background. A tile that
+    // was never written reads as the color of the last clear, so a large,
+    // mostly empty canvas only costs memory where something was drawn, and
+    // clearing it just drops the tiles.
+    class TiledImageDevice : public ImageDevice {
+    public:
+        static constexpr size_t TILE_SHIFT = 8;
+        static constexpr size_t TILE_SIZE = size_t(1) << TILE_SHIFT;
+        static constexpr size_t TILE_MASK = TILE_SIZE - 1;
+
+    private:
+        RGBColor background;
+        size_t columns;
+        std::vector<std::unique_ptr<RGBColor[]>> tiles;
+
+        void allocate() {
+            columns = (width + TILE_MASK) >> TILE_SHIFT;
+            tiles.clear();
+            tiles.resize(columns * ((height + TILE_MASK) >> TILE_SHIFT));
+        }
+
+        std::unique_ptr<RGBColor[]>& slot(size_t x, size_t y) {
+            return tiles[(y >> TILE_SHIFT) * columns + (x >> TILE_SHIFT)];
+        }
+
+        const RGBColor *tile(size_t x, size_t y) const {
+            return tiles[(y >> TILE_SHIFT) * columns + (x >> TILE_SHIFT)].get();
+        }
+
+        static size_t offset(size_t x, size_t y) {
+            return ((y & TILE_MASK) << TILE_SHIFT) | (x & TILE_MASK);
+        }
+
+        // Returns the tile holding (x, y) for writing color, allocating it
+        // if needed, or nullptr if the write would not change the tile.
+        RGBColor *writable(size_t x, size_t y, RGBColor color) {
+            std::unique_ptr<RGBColor[]>& t = slot(x, y);
+            if (!t) {
+                if (color == background) return nullptr;
+                t.reset(new RGBColor[TILE_SIZE * TILE_SIZE]);
+                std::fill_n(t.get(), TILE_SIZE * TILE_SIZE, background);
+            }
+            return t.get();
+        }
+
+    public:
+        explicit TiledImageDevice(size_t width = 800, size_t height = 600) :
+            ImageDevice(width, height) {
+            allocate();
+        }
+
+        TiledImageDevice(const TiledImageDevice& other) = delete;
+        TiledImageDevice(TiledImageDevice&& other) = delete;
+        TiledImageDevice& operator = (const TiledImageDevice& other) = delete;
+        TiledImageDevice& operator = (TiledImageDevice&& other) = delete;
+
+        RGBColor getPixel(ssize_t x, ssize_t y) const override {
+            if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+                throw std::range_error("pixel out of canvas");
+            const RGBColor *t = tile(x, y);
+            return t ? t[offset(x, y)] : background;
+        }
+
+        void setPixel(ssize_t x, ssize_t y, RGBColor color) override {
+            if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+                return;
+            if (RGBColor *t = writable(x, y, color))
+                t[offset(x, y)] = color;
+        }
+
+        void getHSpan(ssize_t x, ssize_t y, size_t len, RGBColor *out) const override {
+            while (len > 0) {
+                size_t n = std::min(len, TILE_SIZE - (x & TILE_MASK));
+                if (const RGBColor *t = tile(x, y))
+                    std::copy_n(t + offset(x, y), n, out);
+                else
+                    std::fill_n(out, n, background);
+                x += n; out += n; len -= n;
+            }
+        }
+
+        void setHSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) override {
+            if (y < 0 || size_t(y) >= height) return;
+            ssize_t x1 = std::max<ssize_t>(x, 0),
+                    x2 = std::min<ssize_t>(x + len, width);
+            while (x1 < x2) {
+                size_t n = std::min(size_t(x2 - x1), TILE_SIZE - (x1 & TILE_MASK));
+                if (RGBColor *t = writable(x1, y, color))
+                    std::fill_n(t + offset(x1, y), n, color);
+                x1 += n;
+            }
+        }
+
+        void setVSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) override {
+            if (x < 0 || size_t(x) >= width) return;
+            ssize_t y1 = std::max<ssize_t>(y, 0),
+                    y2 = std::min<ssize_t>(y + len, height);
+            while (y1 < y2) {
+                size_t n = std::min(size_t(y2 - y1), TILE_SIZE - (y1 & TILE_MASK));
+                if (RGBColor *t = writable(x, y1, color))
+                    for (size_t i = 0; i < n; i++)
+                        t[offset(x, y1 + i)] = color;
+                y1 += n;
+            }
+        }
+
+        void blendPixel(ssize_t x, ssize_t y, RGBColor color, uint8_t alpha) override {
+            if (x < 0 || y < 0 || size_t(x) >= width || size_t(y) >= height)
+                return;
+            const RGBColor *t = tile(x, y);
+            RGBColor pixel = blend(t ? t[offset(x, y)] : background, color, alpha);
+            if (RGBColor *w = writable(x, y, pixel))
+                w[offset(x, y)] = pixel;
+        }
+
+        void clear(RGBColor color) override {
+            background = color;
+            for (auto& t : tiles) t.reset();
+        }
+
+        void reset(size_t width, size_t height) override {
+            ImageDevice::reset(width, height);
+            background = RGBColor();
+            allocate();
+        }
+    };
 }
 
 #endif
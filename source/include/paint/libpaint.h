@@ -0,0 +1,116 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIBPAINT_H__
+#define __LIBPAINT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// The interface of the paint library for rendering in process. It only
+// depends on the standard library and keeps the canvas behind a pointer, so
+// programs built against it keep working with later builds of the library
+// that have the same API_VERSION. Distinct canvases may be used from
+// different threads at once.
+namespace LibPaint {
+
+    constexpr int API_VERSION = 1;
+
+    // The API_VERSION the library was built with.
+    int version();
+
+    enum class LineAlgorithm : int { DDA, Bresenham, FixedDDA };
+    enum class CurveType : int { Bezier, BSpline, CubicBezier };
+    enum class ClipAlgorithm : int { CohenSutherland, LiangBarsky };
+
+    // Byte order of a pixel. The alpha byte of the 32-bit formats is
+    // always set to 255.
+    enum class PixelFormat : int { RGB24, BGR24, RGBA32, BGRA32 };
+
+    // Bytes a pixel of format takes.
+    size_t pixel_size(PixelFormat format);
+
+    // A canvas holding primitives by id, with the drawing state of the
+    // batch language: the color, anti-aliasing and stroke width given to
+    // primitives when they are added. Coordinates are in pixels, with the
+    // origin at the top left. Invalid arguments, taken ids and missing
+    // primitives throw std::invalid_argument; malformed snapshots throw
+    // std::runtime_error.
+    class Canvas {
+    public:
+        explicit Canvas(size_t width = 800, size_t height = 600);
+        ~Canvas();
+        Canvas(Canvas&& other) noexcept;
+        Canvas& operator = (Canvas&& other) noexcept;
+        Canvas(const Canvas& other) = delete;
+        Canvas& operator = (const Canvas& other) = delete;
+
+        size_t width() const;
+        size_t height() const;
+        // Resizes the canvas and removes every primitive.
+        void reset(size_t width, size_t height);
+        // Resizes the canvas, keeping the primitives.
+        void resize(size_t width, size_t height);
+
+        void set_color(uint8_t red, uint8_t green, uint8_t blue);
+        void set_antialias(bool antialias);
+        void set_stroke_width(float width);
+
+        // Add a primitive under id, or under the id after the largest one
+        // if id is negative, and return its id. Point lists hold n (x, y)
+        // pairs.
+        int add_line(float x1, float y1, float x2, float y2,
+                     LineAlgorithm algo = LineAlgorithm::DDA, int id = -1);
+        int add_polygon(const float *xy, size_t n,
+                        LineAlgorithm algo = LineAlgorithm::DDA, int id = -1);
+        int add_ellipse(float x, float y, float rx, float ry, int id = -1);
+        int add_curve(const float *xy, size_t n,
+                      CurveType type = CurveType::Bezier, int id = -1);
+        int add_fill(float x, float y, int id = -1);
+        // Returns false if there is no such primitive.
+        bool remove(int id);
+
+        void translate(int id, float dx, float dy);
+        void rotate(int id, float x, float y, float degrees);
+        void scale(int id, float x, float y, float factor);
+        // Only lines can be clipped.
+        void clip(int id, float x1, float y1, float x2, float y2,
+                  ClipAlgorithm algo = ClipAlgorithm::CohenSutherland);
+
+        // Paints the canvas on white into pixels, width() x height() pixels
+        // whose rows are stride bytes apart; stride is negative for
+        // bottom-up images. Nothing else is allocated.
+        void render(void *pixels, ptrdiff_t stride, PixelFormat format);
+
+        // The rendered canvas as a 24-bit BMP file, the same as the batch
+        // command saveCanvas writes.
+        std::string encode_bmp();
+        // The canvas and its primitives in the snapshot format of
+        // saveSnapshot, and back.
+        std::string encode_snapshot() const;
+        void decode_snapshot(const void *data, size_t size);
+
+    private:
+        struct Impl;
+        std::unique_ptr<Impl> impl;
+    };
+}
+
+#endif
@@ -29,7 +29,8 @@
 #include <utility>
 
 namespace Paint {
-    constexpr int MIN_COORDINATE = -8192, MAX_COORDINATE = 8192; 
+    constexpr int MIN_COORDINATE = -262144, MAX_COORDINATE = 262144;
+    constexpr float MAX_STROKE_WIDTH = 1024.0f;
     struct RGBColor { 
         uint8_t red, green, blue;
 
@@ -38,6 +39,11 @@ namespace Paint {
                  uint8_t blue = 0) noexcept :
             red(red), green(green), blue(blue) { }
 
+        bool operator == (RGBColor rhs) const {
+            return red == rhs.red && green == rhs.green && blue == rhs.blue;
+        }
+        bool operator != (RGBColor rhs) const { return !(*this == rhs); }
+
         std::string to_string() {
             char buf[32];
             sprintf(buf, "#%02x%02x%02x", red, green, blue);
@@ -45,6 +51,15 @@ namespace Paint {
         }
     };
 
+    // Mixes fore over back with the given opacity (0 - 255).
+    inline RGBColor blend(RGBColor back, RGBColor fore, uint8_t alpha) {
+        auto mix = [alpha] (int b, int f) {
+            return uint8_t((b * (255 - alpha) + f * alpha + 127) / 255);
+        };
+        return RGBColor(mix(back.red, fore.red), mix(back.green, fore.green),
+                        mix(back.blue, fore.blue));
+    }
+
     template <typename T>
     struct Point {
         T x, y;
@@ -20,30 +20,109 @@
 #define __PRIMITIVE_H__
 
 #include <paint/device.h>
+#include <algorithm>
+#include <functional>
 #include <list>
+#include <memory>
+#include <vector>
 
 namespace Paint {
+    // Keeps the pixels a primitive wrote the last time it was painted, so
+    // that painting it again after an integer translation replays them
+    // shifted instead of rasterizing again. Only rasterizers that write
+    // solid pixels without reading the device, and whose output shifts
+    // exactly with integral coordinates, may be painted through the cache.
+    class RasterCache {
+    public:
+        // points are the coordinates that move with the primitive and
+        // params everything else its raster depends on besides the color;
+        // rasterize(device) paints the primitive.
+        void paint(ImageDevice& device, RGBColor color,
+                   const std::vector<PointF>& points, const std::vector<float>& params,
+                   const std::function<void(ImageDevice&)>& rasterize);
+
+    private:
+        struct Span {
+            int32_t x, y;
+            uint32_t len;
+            bool vertical;
+        };
+        class Recorder;
+
+        std::vector<Span> spans;
+        std::vector<PointF> points;
+        std::vector<float> params;
+
+        bool matches(const std::vector<PointF>& points,
+                     const std::vector<float>& params, PointI& shift) const;
+        void merge();
+        void replay(ImageDevice& device, RGBColor color, PointI shift) const;
+    };
+
     class Primitive {
     protected:
         RGBColor color;
+        bool antialias = false;
+        float stroke_width = 1.0f;
+        std::unique_ptr<RasterCache> raster_cache;
         explicit Primitive(RGBColor color) : color(color) {}
+        // Copies start without a raster cache.
+        Primitive(const Primitive& other) :
+            color(other.color), antialias(other.antialias), stroke_width(other.stroke_width) {}
+        Primitive& operator = (const Primitive& other) = delete;
+
+        // Sets min and max to the box around points, grown by as far as the
+        // stroke and anti-aliasing may reach past the geometry.
+        bool stroke_bounds(const PointF *points, size_t n, PointF& min, PointF& max) const;
 
     public:
+        enum class Type : int { Line, Polygon, Ellipse, Bezier, BSpline, Fill, Instance };
+
+        virtual Type type() const = 0;
+        // A copy of the primitive; an instance shares its shape with it.
+        virtual std::unique_ptr<Primitive> clone() const = 0;
+        RGBColor get_color() const { return color; }
+        bool get_antialias() const { return antialias; }
+        void set_antialias(bool antialias) { this->antialias = antialias; }
+        float get_stroke_width() const { return stroke_width; }
+        void set_stroke_width(float width) { stroke_width = width; }
+        // Primitives about to be moved around may keep their raster so that
+        // integer translations are painted by copying it. Only the aliased
+        // Bresenham and FixedDDA lines and polygons and the midpoint
+        // ellipse make use of it.
+        bool get_raster_cache() const { return bool(raster_cache); }
+        void set_raster_cache(bool enabled) {
+            if (enabled != bool(raster_cache))
+                raster_cache.reset(enabled ? new RasterCache : nullptr);
+        }
         virtual void paint(ImageDevice& device) = 0;
+        // Sets min and max to a box holding every pixel painting may touch.
+        // Returns false if there is no such box, as for fills, whose extent
+        // depends on what the device holds.
+        virtual bool bounds(PointF& min, PointF& max) const { return false; }
         virtual void translate(float dx, float dy) = 0;
         virtual void rotate(float x, float y, float rdeg) = 0;
         virtual void scale(float x, float y, float s) = 0;
+        // Moves the primitive into the coordinates of a view that shows the
+        // canvas from origin on, each canvas pixel zoom view pixels wide.
+        // The stroke is magnified along with the geometry.
+        void to_view(PointF origin, float zoom) {
+            translate(-origin.x, -origin.y);
+            if (zoom == 1.0f) return;
+            scale(0.0f, 0.0f, zoom);
+            stroke_width = std::min(std::max(stroke_width * zoom, 1.0f), MAX_STROKE_WIDTH);
+        }
         virtual std::string to_string() = 0;
         virtual ~Primitive() = default;
     };
 
 
-    enum class CurveDrawingAlgorithm : int { Bezier, BSpline };
+    enum class CurveDrawingAlgorithm : int { Bezier, BSpline, CubicBezier };
     enum class LineClippingAlgorithm : int { CohenSutherland, LiangBarsky };
 
     class Line : public Primitive {
     public:
-        enum class Algorithm : int { DDA, Bresenham };
+        enum class Algorithm : int { DDA, Bresenham, FixedDDA };
         PointF p1, p2;
         Algorithm algo;
 
@@ -51,8 +130,21 @@ namespace Paint {
         Line(PointF p1, PointF p2, RGBColor color, Algorithm algo) :
             Primitive(color), p1(p1), p2(p2), algo(algo) {};
 
+        Type type() const override { return Type::Line; }
+        std::unique_ptr<Primitive> clone() const override {
+            return std::unique_ptr<Primitive>(new Line(*this));
+        }
+
         void paint(ImageDevice& device) override;
 
+        // Paints lines[0 .. n) in order, stepping several lines at once.
+        static void paint_batch(ImageDevice& device, Line* const* lines, size_t n);
+
+        bool bounds(PointF& min, PointF& max) const override {
+            const PointF pts[2] = { p1, p2 };
+            return stroke_bounds(pts, 2, min, max);
+        }
+
         void translate(float dx, float dy) override {
             p1.x += dx; p1.y += dy;
             p2.x += dx; p2.y += dy;
@@ -79,8 +171,15 @@ namespace Paint {
                 RGBColor color, Line::Algorithm algo) :
             Primitive(color), points(std::move(points)), algo(algo) {}
 
+        Type type() const override { return Type::Polygon; }
+        std::unique_ptr<Primitive> clone() const override {
+            return std::unique_ptr<Primitive>(new Polygon(*this));
+        }
+
         void paint(ImageDevice& device) override;
 
+        bool bounds(PointF& min, PointF& max) const override;
+
         void translate(float dx, float dy) override {
             for (auto& p : points) {
                 p.first += dx;
@@ -104,8 +203,15 @@ namespace Paint {
         Ellipse(float x, float y, float rx, float ry, RGBColor color) :
             Primitive(color), x(x), y(y), rx(rx), ry(ry) {}
 
+        Type type() const override { return Type::Ellipse; }
+        std::unique_ptr<Primitive> clone() const override {
+            return std::unique_ptr<Primitive>(new Ellipse(*this));
+        }
+
         void paint(ImageDevice& device) override;
 
+        bool bounds(PointF& min, PointF& max) const override;
+
         void translate(float dx, float dy) override {
             x += dx;
             y += dy;
@@ -122,6 +228,36 @@ namespace Paint {
         }
     };
 
+    // Flood fills the 4-connected region around seed that has the seed's
+    // color at the time the fill is painted, so it fills whatever the
+    // primitives painted before it have enclosed.
+    class Fill : public Primitive {
+    public:
+        PointF seed;
+
+        Fill(PointF seed, RGBColor color) : Primitive(color), seed(seed) {}
+
+        Type type() const override { return Type::Fill; }
+        std::unique_ptr<Primitive> clone() const override {
+            return std::unique_ptr<Primitive>(new Fill(*this));
+        }
+
+        void paint(ImageDevice& device) override;
+
+        void translate(float dx, float dy) override {
+            seed.x += dx;
+            seed.y += dy;
+        }
+
+        void rotate(float x, float y, float rdeg) override;
+
+        void scale(float x, float y, float s) override;
+
+        std::string to_string() override {
+            return "fill " + color.to_string() + " " + seed.to_string();
+        }
+    };
+
     class ParametricCurve : public Primitive {
     protected:
         explicit ParametricCurve(RGBColor color) : Primitive(color) {}
@@ -131,6 +267,12 @@ namespace Paint {
     public:
         void paint(ImageDevice& device) override;
         void translate(float dx, float dy) override = 0;
+        // The curve as a polyline with segments at most 4 pixels long and
+        // within a quarter pixel of the curve.
+        virtual std::vector<PointF> flatten();
+        // Paints a flattened curve anti-aliased or with a stroke width.
+        static void paint_flattened(ImageDevice& device, const std::vector<PointF>& points,
+                                    RGBColor color, bool antialias, float stroke_width);
         void rotate(float x, float y, float rdeg) override = 0;
         void scale(float x, float y, float s) override = 0;
     };
@@ -139,10 +281,33 @@ namespace Paint {
     private:
         PointF eval(float t) override;
 
+        size_t segments() const { return (points.size() + 1) / 3; }
+        // Control points of cubic segment i, raised from a lower degree for
+        // a short last segment.
+        void segment(size_t i, PointF c[4]) const;
+        // Appends the flattening of segments [first, last) to pts.
+        void flatten_segments(size_t first, size_t last, std::vector<PointF>& pts) const;
+        void paint_segments(ImageDevice& device, size_t first, size_t last);
+
     public:
         std::vector<PointF> points;
-        Bezier(std::vector<PointF> points, RGBColor color) :
-            ParametricCurve(color), points(std::move(points)) { }
+        // Whether points are a chain of cubic segments sharing their end
+        // points (p0 .. p3, p3 .. p6, ...) rather than the control points of
+        // a single curve of degree n - 1. A chain costs O(1) per sample and
+        // is painted a segment at a time, skipping segments whose control
+        // points lie off the device.
+        bool piecewise = false;
+
+        Bezier(std::vector<PointF> points, RGBColor color, bool piecewise = false) :
+            ParametricCurve(color), points(std::move(points)), piecewise(piecewise) { }
+        Type type() const override { return Type::Bezier; }
+        std::unique_ptr<Primitive> clone() const override {
+            return std::unique_ptr<Primitive>(new Bezier(*this));
+        }
+        void paint(ImageDevice& device) override;
+        // Each segment lies within the box of its control points.
+        bool bounds(PointF& min, PointF& max) const override;
+        std::vector<PointF> flatten() override;
         void translate(float dx, float dy) override;
         void rotate(float x, float y, float rdeg) override;
         void scale(float x, float y, float s) override;
@@ -162,15 +327,85 @@ namespace Paint {
         size_t order;
         std::vector<PointF> points;
         BSpline(std::vector<PointF> points, RGBColor color, size_t order = 4);
+        Type type() const override { return Type::BSpline; }
+        std::unique_ptr<Primitive> clone() const override {
+            return std::unique_ptr<Primitive>(new BSpline(*this));
+        }
+        bool bounds(PointF& min, PointF& max) const override;
         void translate(float dx, float dy) override;
         void rotate(float x, float y, float rdeg) override;
         void scale(float x, float y, float s) override;
         void update_knot();
+        const std::vector<float>& get_knot() const { return knot; }
+        void set_knot(std::vector<float> knot) { this->knot = std::move(knot); }
 
         std::string to_string() override {
             return "BSpline " + color.to_string();
         }
     };
+
+    // Geometry shared by any number of instances. The polygon or curve a
+    // shape holds is in the shape's own coordinates and never changes once
+    // the shape is made; a curve is flattened up front so that its
+    // instances need not evaluate it again.
+    class Shape {
+    public:
+        // prototype must be a Polygon, Bezier or BSpline; its color and
+        // style are ignored.
+        explicit Shape(Primitive *prototype);
+
+        const Primitive& get_prototype() const { return *prototype; }
+        const std::vector<PointF>& get_flattened() const { return flattened; }
+        // The box around the control points of the prototype.
+        PointF get_min() const { return min; }
+        PointF get_max() const { return max; }
+
+    private:
+        std::unique_ptr<Primitive> prototype;
+        std::vector<PointF> flattened;
+        PointF min, max;
+    };
+
+    // A shape drawn with its own color, style and transform. Transforming
+    // an instance only updates its matrix, so thousands of instances of a
+    // shape cost little more than one copy of its geometry.
+    class Instance : public Primitive {
+    public:
+        std::shared_ptr<const Shape> shape;
+        // Maps shape coordinates p to mat * p + offset.
+        float mat[2][2] = { { 1.0f, 0.0f }, { 0.0f, 1.0f } };
+        PointF offset;
+
+        Instance(std::shared_ptr<const Shape> shape, RGBColor color, PointF offset) :
+            Primitive(color), shape(std::move(shape)), offset(offset) {}
+
+        Type type() const override { return Type::Instance; }
+        std::unique_ptr<Primitive> clone() const override {
+            return std::unique_ptr<Primitive>(new Instance(*this));
+        }
+
+        PointF apply(PointF p) const {
+            return PointF(mat[0][0] * p.x + mat[0][1] * p.y + offset.x,
+                          mat[1][0] * p.x + mat[1][1] * p.y + offset.y);
+        }
+
+        void paint(ImageDevice& device) override;
+
+        bool bounds(PointF& min, PointF& max) const override;
+
+        void translate(float dx, float dy) override {
+            offset.x += dx;
+            offset.y += dy;
+        }
+
+        void rotate(float x, float y, float rdeg) override;
+
+        void scale(float x, float y, float s) override;
+
+        std::string to_string() override {
+            return "instance " + color.to_string();
+        }
+    };
 }
 
 #endif //PAINT_PRIMITIVE_H
@@ -0,0 +1,69 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <paint/paint.h>
+#include <paint/primitive.h>
+
+namespace Paint {
+
+    using PrimitiveMap = std::map<int, std::unique_ptr<Primitive>>;
+    using ShapeMap = std::map<int, std::shared_ptr<const Shape>>;
+
+    // Binary snapshot of a canvas: its size, every shape and every
+    // primitive with its id, color, algorithm and geometry. All fields are
+    // little-endian.
+    //
+    //      header:  "PAINTSNP", u32 version, u32 width, u32 height, u32 count,
+    //               u32 nshapes
+    //      record:  u8 type, u8 algo, u8 red, u8 green, u8 blue, u8 flags,
+    //               u8 pad[2], i32 id, u32 order, u32 npoints, u32 nknots,
+    //               f32 stroke_width, f32 points[npoints][2], f32 knots[nknots]
+    //
+    // The header is followed by nshapes records holding the prototype of
+    // each shape under its id, then by count primitive records. An ellipse
+    // stores its center and radii as two points, a fill its seed, and an
+    // instance the id of its shape in order and the columns of its matrix
+    // and its offset as three points. The algo of a Bezier curve is 1 for a
+    // chain of cubic segments. Bit 0 of flags is set for anti-aliased
+    // primitives.
+    std::string encode_snapshot(size_t width, size_t height,
+                                const PrimitiveMap& primitives, const ShapeMap& shapes);
+
+    // Replaces primitives and shapes on success; throws std::runtime_error
+    // on malformed input and leaves the arguments untouched.
+    void decode_snapshot(const char *data, size_t size, size_t& width, size_t& height,
+                         PrimitiveMap& primitives, ShapeMap& shapes);
+
+    // A copy of prim, as Primitive::clone makes it.
+    std::unique_ptr<Primitive> copy_primitive(const Primitive& prim);
+
+    void save_snapshot(const std::string& filename, size_t width, size_t height,
+                       const PrimitiveMap& primitives, const ShapeMap& shapes);
+    void load_snapshot(const std::string& filename, size_t& width, size_t& height,
+                       PrimitiveMap& primitives, ShapeMap& shapes);
+}
+
+#endif
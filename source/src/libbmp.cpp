@@ -21,6 +21,8 @@
  */
 #include <fstream>
 #include <cmath>
+#include <cstdint>
+#include <algorithm>
 #include "libbmp.h"
 
 #define BMP_MAGIC 19778
@@ -173,6 +175,52 @@ namespace LibBmp {
         return BmpError::BMP_OK;
     }
 
+    std::string
+    encode_header (const int width,
+                   const int height)
+    {
+        // Same header as BmpImg; the size field saturates for images
+        // beyond 4 GiB.
+        const size_t len_row = 3 * size_t (width) + BMP_GET_PADDING (width);
+        BmpHeader header;
+        header.bfSize = std::min<size_t> (len_row * height, UINT32_MAX);
+        header.biWidth = width;
+        header.biHeight = height;
+        
+        const unsigned short magic = BMP_MAGIC;
+        std::string out (reinterpret_cast<const char*>(&magic), sizeof (magic));
+        out.append (reinterpret_cast<const char*>(&header), sizeof (header));
+        return out;
+    }
+
+    enum BmpError
+    write_rows (const std::string& filename,
+                const int width,
+                const int height,
+                const std::function<void (int, unsigned char*)>& fill_row)
+    {
+        std::ofstream f_img (filename.c_str (), std::ios::binary);
+        
+        if (!f_img.is_open ())
+            return BmpError::BMP_FILE_NOT_OPENED;
+        
+        const std::string header = encode_header (width, height);
+        f_img.write (header.data (), header.size ());
+        
+        // The padding stays zero as fill_row only writes the pixels
+        const size_t len_row = 3 * size_t (width) + BMP_GET_PADDING (width);
+        std::vector<unsigned char> row (len_row, 0);
+        for (int y = height - 1; y >= 0; y--)
+        {
+            fill_row (y, row.data ());
+            f_img.write (reinterpret_cast<const char*>(row.data ()), len_row);
+        }
+        
+        if (!f_img.flush ())
+            return BmpError::BMP_ERROR;
+        return BmpError::BMP_OK;
+    }
+
     enum BmpError
     BmpImg::read (const std::string& filename)
     {	
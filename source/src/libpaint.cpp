@@ -0,0 +1,230 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <paint/paint.h>
+#include <paint/canvas.h>
+#include <paint/primitive.h>
+#include <paint/snapshot.h>
+#include <paint/libpaint.h>
+
+#include <libbmp.h>
+
+// Largest number of points of a polygon or curve, as in scripts.
+static constexpr size_t MAX_POINTS = 1000000;
+
+static const Paint::BufferImageDevice::Layout layouts[] {
+    { 3, 0, 1, 2, -1 },     // RGB24
+    { 3, 2, 1, 0, -1 },     // BGR24
+    { 4, 0, 1, 2, 3 },      // RGBA32
+    { 4, 2, 1, 0, 3 },      // BGRA32
+};
+
+static const Paint::BufferImageDevice::Layout& layout(LibPaint::PixelFormat format) {
+    size_t i = static_cast<size_t>(format);
+    if (i >= sizeof(layouts) / sizeof(layouts[0]))
+        throw std::invalid_argument("unknown pixel format");
+    return layouts[i];
+}
+
+static Paint::Line::Algorithm line_algorithm(LibPaint::LineAlgorithm algo) {
+    if (static_cast<unsigned>(algo) > static_cast<unsigned>(LibPaint::LineAlgorithm::FixedDDA))
+        throw std::invalid_argument("unknown line algorithm");
+    return Paint::Line::Algorithm(algo);
+}
+
+static Paint::LineClippingAlgorithm clip_algorithm(LibPaint::ClipAlgorithm algo) {
+    if (static_cast<unsigned>(algo) > static_cast<unsigned>(LibPaint::ClipAlgorithm::LiangBarsky))
+        throw std::invalid_argument("unknown clipping algorithm");
+    return Paint::LineClippingAlgorithm(algo);
+}
+
+static void check_size(size_t width, size_t height) {
+    if (width > size_t(Paint::MAX_COORDINATE) || height > size_t(Paint::MAX_COORDINATE))
+        throw std::invalid_argument("canvas size out of range");
+}
+
+template <typename PointT>
+static std::vector<PointT> read_points(const float *xy, size_t n) {
+    if (!xy || n < 2 || n > MAX_POINTS)
+        throw std::invalid_argument("invalid number of points");
+    std::vector<PointT> points;
+    points.reserve(n);
+    for (size_t i = 0; i < n; i++)
+        points.emplace_back(xy[2 * i], xy[2 * i + 1]);
+    return points;
+}
+
+namespace LibPaint {
+
+    int version() { return API_VERSION; }
+
+    size_t pixel_size(PixelFormat format) { return layout(format).bytes; }
+
+    struct Canvas::Impl {
+        Paint::Canvas<Paint::BufferImageDevice> canvas;
+        Paint::RGBColor color;
+        bool antialias = false;
+        float stroke_width = 1.0f;
+
+        // Takes prim over, applying the drawing state to it.
+        int add(Paint::Primitive *prim, int id) {
+            prim->set_antialias(antialias);
+            prim->set_stroke_width(stroke_width);
+            int added = id < 0 ? canvas.add_primitive(prim) : canvas.add_primitive(prim, id);
+            if (added < 0)
+                throw std::invalid_argument("id " + std::to_string(id) + " already exists");
+            return added;
+        }
+
+        Paint::Primitive& operator[] (int id) {
+            auto it = canvas.primitives.find(id);
+            if (it == canvas.primitives.end())
+                throw std::invalid_argument("id " + std::to_string(id) + " does not exist");
+            return *it->second;
+        }
+    };
+
+    Canvas::Canvas(size_t width, size_t height) : impl(new Impl) {
+        check_size(width, height);
+        impl->canvas.reset(width, height);
+    }
+
+    Canvas::~Canvas() = default;
+    Canvas::Canvas(Canvas&& other) noexcept = default;
+    Canvas& Canvas::operator = (Canvas&& other) noexcept = default;
+
+    size_t Canvas::width() const { return impl->canvas.getWidth(); }
+    size_t Canvas::height() const { return impl->canvas.getHeight(); }
+
+    void Canvas::reset(size_t width, size_t height) {
+        resize(width, height);
+        impl->canvas.primitives.clear();
+        impl->canvas.shapes.clear();
+    }
+
+    void Canvas::resize(size_t width, size_t height) {
+        check_size(width, height);
+        impl->canvas.reset(width, height);
+    }
+
+    void Canvas::set_color(uint8_t red, uint8_t green, uint8_t blue) {
+        impl->color = Paint::RGBColor(red, green, blue);
+    }
+
+    void Canvas::set_antialias(bool antialias) {
+        impl->antialias = antialias;
+    }
+
+    void Canvas::set_stroke_width(float width) {
+        if (!(width >= 1.0f && width <= Paint::MAX_STROKE_WIDTH))
+            throw std::invalid_argument("stroke width out of range");
+        impl->stroke_width = width;
+    }
+
+    int Canvas::add_line(float x1, float y1, float x2, float y2,
+                         LineAlgorithm algo, int id) {
+        return impl->add(new Paint::Line(Paint::PointF(x1, y1), Paint::PointF(x2, y2),
+                                         impl->color, line_algorithm(algo)), id);
+    }
+
+    int Canvas::add_polygon(const float *xy, size_t n, LineAlgorithm algo, int id) {
+        return impl->add(new Paint::Polygon(read_points<std::pair<float, float>>(xy, n),
+                                            impl->color, line_algorithm(algo)), id);
+    }
+
+    int Canvas::add_ellipse(float x, float y, float rx, float ry, int id) {
+        return impl->add(new Paint::Ellipse(x, y, rx, ry, impl->color), id);
+    }
+
+    int Canvas::add_curve(const float *xy, size_t n, CurveType type, int id) {
+        std::vector<Paint::PointF> points = read_points<Paint::PointF>(xy, n);
+        switch (type) {
+        case CurveType::Bezier:
+            return impl->add(new Paint::Bezier(std::move(points), impl->color), id);
+        case CurveType::BSpline:
+            return impl->add(new Paint::BSpline(std::move(points), impl->color), id);
+        case CurveType::CubicBezier:
+            return impl->add(new Paint::Bezier(std::move(points), impl->color, true), id);
+        }
+        throw std::invalid_argument("unknown curve type");
+    }
+
+    int Canvas::add_fill(float x, float y, int id) {
+        return impl->add(new Paint::Fill(Paint::PointF(x, y), impl->color), id);
+    }
+
+    bool Canvas::remove(int id) {
+        return impl->canvas.primitives.erase(id) > 0;
+    }
+
+    void Canvas::translate(int id, float dx, float dy) {
+        (*impl)[id].translate(dx, dy);
+    }
+
+    void Canvas::rotate(int id, float x, float y, float degrees) {
+        (*impl)[id].rotate(x, y, degrees);
+    }
+
+    void Canvas::scale(int id, float x, float y, float factor) {
+        (*impl)[id].scale(x, y, factor);
+    }
+
+    void Canvas::clip(int id, float x1, float y1, float x2, float y2, ClipAlgorithm algo) {
+        Paint::Primitive& prim = (*impl)[id];
+        if (prim.type() != Paint::Primitive::Type::Line)
+            throw std::invalid_argument("id " + std::to_string(id) + " is not a line");
+        static_cast<Paint::Line&>(prim).clip(x1, y1, x2, y2, clip_algorithm(algo));
+    }
+
+    void Canvas::render(void *pixels, ptrdiff_t stride, PixelFormat format) {
+        Paint::Canvas<Paint::BufferImageDevice>& canvas = impl->canvas;
+        canvas.attach(static_cast<uint8_t*>(pixels), stride, layout(format));
+        canvas.clear(Paint::Colors::white);
+        canvas.paint();
+    }
+
+    // The rows are rendered in place, from the last one up.
+    std::string Canvas::encode_bmp() {
+        size_t width = this->width(), height = this->height();
+        std::string out = LibBmp::encode_header(width, height);
+        size_t header = out.size(), row = (3 * width + 3) & ~size_t(3);
+        out.resize(header + row * height);
+        if (height > 0)
+            render(&out[header + row * (height - 1)], -ptrdiff_t(row), PixelFormat::BGR24);
+        return out;
+    }
+
+    std::string Canvas::encode_snapshot() const {
+        return Paint::encode_snapshot(width(), height(),
+                                      impl->canvas.primitives, impl->canvas.shapes);
+    }
+
+    void Canvas::decode_snapshot(const void *data, size_t size) {
+        size_t width, height;
+        Paint::decode_snapshot(static_cast<const char*>(data), size, width, height,
+                               impl->canvas.primitives, impl->canvas.shapes);
+        impl->canvas.reset(width, height);
+    }
+}
@@ -0,0 +1,116 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SRC_PRIMITIVE_COVERAGE_H__
+#define __SRC_PRIMITIVE_COVERAGE_H__
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <paint/paint.h>
+#include <paint/device.h>
+
+// Collects the anti-aliased coverage of one primitive before it is blended
+// into the device. Parts of a primitive (polygon edges, curve segments,
+// the two halves of an ellipse) may touch the same pixel; only the largest
+// coverage is kept so shared pixels are not blended twice. Pixels outside
+// the device are dropped on insertion.
+class CoverageBuffer {
+public:
+    explicit CoverageBuffer(Paint::ImageDevice& device) :
+        device(device), width(device.getWidth()), height(device.getHeight()) { }
+
+    long getWidth() const { return width; }
+    long getHeight() const { return height; }
+
+    void add(long x, long y, float coverage) {
+        if (x < 0 || y < 0 || x >= width || y >= height || !(coverage > 0.0f))
+            return;
+        uint8_t alpha = std::lround(std::min(coverage, 1.0f) * 255.0f);
+        if (alpha) samples.push_back({ uint64_t(y) * width + x, alpha });
+    }
+
+    // Blends every covered pixel once, in row order, and empties the buffer.
+    void blend(Paint::RGBColor color) {
+        std::sort(samples.begin(), samples.end(), [] (const Sample& a, const Sample& b) {
+            return a.pos < b.pos;
+        });
+        for (size_t i = 0; i < samples.size(); ) {
+            uint64_t pos = samples[i].pos;
+            uint8_t alpha = 0;
+            for (; i < samples.size() && samples[i].pos == pos; i++)
+                alpha = std::max(alpha, samples[i].alpha);
+            device.blendPixel(pos % width, pos / width, color, alpha);
+        }
+        samples.clear();
+    }
+
+private:
+    struct Sample {
+        uint64_t pos;
+        uint8_t alpha;
+    };
+
+    Paint::ImageDevice& device;
+    long width, height;
+    std::vector<Sample> samples;
+};
+
+// Xiaolin Wu's line from (x0, y0) to (x1, y1), pixel centres on integer
+// coordinates. Every step along the major axis splits one unit of coverage
+// between the two nearest pixels on the minor axis. With caps the end
+// pixels are weighted by how far the segment reaches into them; without,
+// they get full weight so that segments of a polyline join seamlessly.
+static void wu_line(CoverageBuffer& cov, float x0, float y0, float x1, float y1,
+                    bool caps = true) {
+    bool steep = std::fabs(y1 - y0) > std::fabs(x1 - x0);
+    if (steep) { std::swap(x0, y0); std::swap(x1, y1); }
+    if (x0 > x1) { std::swap(x0, x1); std::swap(y0, y1); }
+    auto plot = [&] (long major, float minor, float weight) {
+        float base = std::floor(minor), frac = minor - base;
+        long m = long(base);
+        if (steep) {
+            cov.add(m, major, (1.0f - frac) * weight);
+            cov.add(m + 1, major, frac * weight);
+        } else {
+            cov.add(major, m, (1.0f - frac) * weight);
+            cov.add(major, m + 1, frac * weight);
+        }
+    };
+    float dx = x1 - x0, gradient = dx == 0.0f ? 0.0f : (y1 - y0) / dx;
+    long xpxl1 = std::lround(x0), xpxl2 = std::lround(x1);
+    float yend1 = y0 + gradient * (xpxl1 - x0),
+          yend2 = y1 + gradient * (xpxl2 - x1);
+    if (xpxl1 == xpxl2) {
+        plot(xpxl1, (yend1 + yend2) / 2.0f, caps ? std::max(dx, 1.0f / 8) : 1.0f);
+        return;
+    }
+    plot(xpxl1, yend1, caps ? xpxl1 + 0.5f - x0 : 1.0f);
+    plot(xpxl2, yend2, caps ? x1 - (xpxl2 - 0.5f) : 1.0f);
+    long major_limit = steep ? cov.getHeight() : cov.getWidth();
+    long first = std::max(xpxl1 + 1, 0L), last = std::min(xpxl2 - 1, major_limit - 1);
+    float intery = yend1 + gradient * (first - xpxl1);
+    for (long x = first; x <= last; x++, intery += gradient)
+        plot(x, intery, 1.0f);
+}
+
+#endif
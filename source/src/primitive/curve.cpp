@@ -20,11 +20,14 @@
 #include <utility>
 #include <stdexcept>
 #include <numeric>
+#include <algorithm>
 #include <paint/paint.h>
 #include <paint/primitive.h>
 #include <paint/util.h>
 #include <cassert>
 #include "algo.h"
+#include "coverage.h"
+#include "stroke.h"
 
 using std::lround;          // from <cmath>
 using std::abs; 
@@ -51,7 +54,8 @@ static void DrawEllipse_Midpoint(Paint::ImageDevice& device, Paint::RGBColor col
     quaddraw(irx, 0);
     
     for (int i = 0; i < 2; i++) {
-        long long p = iry2 - irx2 * iry + irx2 / 4.0;
+        // iry2 - irx2 * iry + irx2 / 4 truncated toward zero, in integers
+        long long p = (4 * (iry2 - irx2 * iry) + irx2) / 4;
         long long px = 0, py = 2 * irx2 * iry;
         int cx = 0, cy = iry;
         while (px < py) {
@@ -71,14 +75,75 @@ static void DrawEllipse_Midpoint(Paint::ImageDevice& device, Paint::RGBColor col
     }
 }
 
+// Anti-aliased ellipse. Each integer column within the part of the ellipse
+// where |dy/dx| <= 1 gets the exact y of both halves, split between the two
+// nearest rows; the steeper part is done by rows the same way.
+static void DrawEllipse_AA(CoverageBuffer& cov, float x, float y, float rx, float ry) {
+    for (float v : { x, y, rx, ry })
+        limit_range(v, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE);
+    rx = abs(rx); ry = abs(ry);
+    if (rx == 0.0f || ry == 0.0f) {
+        wu_line(cov, x - rx, y - ry, x + rx, y + ry);
+        return;
+    }
+    auto split = [&] (bool columns, long major, float minor) {
+        float base = std::floor(minor), frac = minor - base;
+        long m = long(base);
+        if (columns) {
+            cov.add(major, m, 1.0f - frac);
+            cov.add(major, m + 1, frac);
+        } else {
+            cov.add(m, major, 1.0f - frac);
+            cov.add(m + 1, major, frac);
+        }
+    };
+    float diag = std::sqrt(rx * rx + ry * ry);
+    float xt = rx * rx / diag, yt = ry * ry / diag;
+    for (long i = std::ceil(x - xt), last = std::floor(x + xt); i <= last; i++) {
+        float t = (i - x) / rx, h = ry * std::sqrt(std::max(0.0f, 1.0f - t * t));
+        split(true, i, y - h);
+        split(true, i, y + h);
+    }
+    for (long j = std::ceil(y - yt), last = std::floor(y + yt); j <= last; j++) {
+        float t = (j - y) / ry, w = rx * std::sqrt(std::max(0.0f, 1.0f - t * t));
+        split(false, j, x - w);
+        split(false, j, x + w);
+    }
+}
+
+// Flattens the curve on [tl, tr] into segments that are short and close to
+// their chord, passing every point after pl to emit.
 template <typename T1, typename T2>
-static void draw_curve_recursive(float tl, float tr, Paint::PointF pl, Paint::PointF pr, T1&& fn, T2&& setpixel) {
-    if ((Paint::pf2pi(pl) - Paint::pf2pi(pr)).lmax() <= 1) return;
+static void flatten_curve(float tl, float tr, Paint::PointF pl, Paint::PointF pr,
+        T1&& fn, T2&& emit, int depth = 0) {
     float tmid = (tl + tr) / 2.0f;
     Paint::PointF pmid = fn(tmid);
-    draw_curve_recursive(tl, tmid, pl, pmid, fn, setpixel);
+    if (depth >= 24 || ((pr - pl).lmax() <= 4.0f &&
+                        (pmid - 0.5f * (pl + pr)).lmax() <= 0.25f)) {
+        emit(pmid);
+        emit(pr);
+        return;
+    }
+    flatten_curve(tl, tmid, pl, pmid, fn, emit, depth + 1);
+    flatten_curve(tmid, tr, pmid, pr, fn, emit, depth + 1);
+}
+
+static Paint::PointF eval_cubic(const Paint::PointF c[4], float u) {
+    float v = 1.0f - u;
+    return (v * v * v) * c[0] + (3.0f * u * v * v) * c[1] +
+           (3.0f * u * u * v) * c[2] + (u * u * u) * c[3];
+}
+
+template <typename T1, typename T2>
+static void draw_curve_recursive(float tl, float tr, Paint::PointF pl, Paint::PointF pr, T1&& fn, T2&& setpixel,
+                                 int depth = 0) {
+    // a curve that jumps never gets within a pixel, so stop where t runs out of precision
+    if (depth >= 32 || (Paint::pf2pi(pl) - Paint::pf2pi(pr)).lmax() <= 1) return;
+    float tmid = (tl + tr) / 2.0f;
+    Paint::PointF pmid = fn(tmid);
+    draw_curve_recursive(tl, tmid, pl, pmid, fn, setpixel, depth + 1);
     setpixel(lround(pmid.x), lround(pmid.y));
-    draw_curve_recursive(tmid, tr, pmid, pr, fn, setpixel);
+    draw_curve_recursive(tmid, tr, pmid, pr, fn, setpixel, depth + 1);
 }
 
 template <typename T1, typename T2>
@@ -95,7 +160,31 @@ namespace Paint {
     // class Ellipse : public Element
     //
     void Ellipse::paint(ImageDevice& device) {
-        DrawEllipse_Midpoint(device, color, x, y, rx, ry);    
+        if (stroke_width > 1.0f) {
+            Stroker stroker(stroke_width, antialias);
+            stroker.ellipse(x, y, rx, ry);
+            stroker.fill(device, color);
+            return;
+        }
+        if (antialias) {
+            CoverageBuffer cov(device);
+            DrawEllipse_AA(cov, x, y, rx, ry);
+            cov.blend(color);
+            return;
+        }
+        auto draw = [this] (ImageDevice& target) {
+            DrawEllipse_Midpoint(target, color, x, y, rx, ry);
+        };
+        if (raster_cache)
+            raster_cache->paint(device, color, { PointF(x, y) }, { rx, ry }, draw);
+        else
+            draw(device);
+    }
+
+    bool Ellipse::bounds(PointF& min, PointF& max) const {
+        float ax = std::fabs(rx), ay = std::fabs(ry);
+        const PointF pts[2] = { PointF(x - ax, y - ay), PointF(x + ax, y + ay) };
+        return stroke_bounds(pts, 2, min, max);
     }
 
     void Ellipse::scale(float x, float y, float s) {
@@ -108,16 +197,51 @@ namespace Paint {
     //
 
     void ParametricCurve::paint(Paint::ImageDevice &device) {
+        if (antialias || stroke_width > 1.0f) {
+            paint_flattened(device, flatten(), color, antialias, stroke_width);
+            return;
+        }
         draw_curve_recursive_wrapper(0.0f, 1.0f,
             [this] (float t) { return eval(t); },
             [&] (int x, int y) { device.setPixel(x, y, color); } );
     }
 
+    std::vector<PointF> ParametricCurve::flatten() {
+        std::vector<PointF> pts = { eval(0.0f) };
+        flatten_curve(0.0f, 1.0f, pts[0], eval(1.0f),
+            [this] (float t) { return eval(t); },
+            [&] (PointF p) { pts.push_back(p); });
+        return pts;
+    }
+
+    void ParametricCurve::paint_flattened(ImageDevice& device, const std::vector<PointF>& pts,
+                                          RGBColor color, bool antialias, float stroke_width) {
+        if (stroke_width > 1.0f) {
+            Stroker stroker(stroke_width, antialias);
+            stroker.polyline(pts, false);
+            stroker.fill(device, color);
+        } else {
+            // Uncapped segments join seamlessly.
+            CoverageBuffer cov(device);
+            for (size_t i = 1; i < pts.size(); i++)
+                wu_line(cov, pts[i-1].x, pts[i-1].y, pts[i].x, pts[i].y, false);
+            cov.blend(color);
+        }
+    }
+
     //
     // class Bezier : public ParametricCurve
     //
 
     PointF Bezier::eval(float t) {
+        if (piecewise && points.size() >= 2) {
+            size_t n = segments();
+            float s = std::max(t, 0.0f) * n;
+            size_t i = std::min(size_t(s), n - 1);
+            PointF c[4];
+            segment(i, c);
+            return eval_cubic(c, s - i);
+        }
         std::vector<PointF> pts(points.begin(), points.end());
         while (pts.size() > 1) {
             for (size_t i = 0; i < pts.size() - 1; i++)
@@ -127,6 +251,98 @@ namespace Paint {
         return pts[0];
     }
 
+    void Bezier::segment(size_t i, PointF c[4]) const {
+        const PointF *p = &points[3 * i];
+        switch (points.size() - 1 - 3 * i) {
+        case 1:
+            c[0] = p[0];
+            c[1] = p[0] + (1.0f / 3.0f) * (p[1] - p[0]);
+            c[2] = p[0] + (2.0f / 3.0f) * (p[1] - p[0]);
+            c[3] = p[1];
+            break;
+        case 2:
+            c[0] = p[0];
+            c[1] = p[0] + (2.0f / 3.0f) * (p[1] - p[0]);
+            c[2] = p[2] + (2.0f / 3.0f) * (p[1] - p[2]);
+            c[3] = p[2];
+            break;
+        default:
+            std::copy_n(p, 4, c);
+        }
+    }
+
+    void Bezier::flatten_segments(size_t first, size_t last, std::vector<PointF>& pts) const {
+        pts.push_back(points[3 * first]);
+        for (size_t i = first; i < last; i++) {
+            PointF c[4];
+            segment(i, c);
+            flatten_curve(0.0f, 1.0f, c[0], c[3],
+                [&c] (float u) { return eval_cubic(c, u); },
+                [&] (PointF p) { pts.push_back(p); });
+        }
+    }
+
+    std::vector<PointF> Bezier::flatten() {
+        if (!piecewise || points.size() < 2) return ParametricCurve::flatten();
+        std::vector<PointF> pts;
+        flatten_segments(0, segments(), pts);
+        return pts;
+    }
+
+    // A segment lies within the convex hull of its control points, so one
+    // whose bounding box misses the device by more than the stroke can
+    // reach is skipped. Runs of segments that are not skipped are painted
+    // together to keep the joins between them.
+    void Bezier::paint(ImageDevice& device) {
+        if (!piecewise || points.size() < 2) {
+            ParametricCurve::paint(device);
+            return;
+        }
+        float margin = stroke_width * Stroker::MITER_LIMIT + 2.0f;
+        float right = device.getWidth() + margin, bottom = device.getHeight() + margin;
+        auto visible = [&] (size_t i) {
+            PointF c[4];
+            segment(i, c);
+            float x1 = c[0].x, x2 = c[0].x, y1 = c[0].y, y2 = c[0].y;
+            for (int k = 1; k < 4; k++) {
+                x1 = std::min(x1, c[k].x); x2 = std::max(x2, c[k].x);
+                y1 = std::min(y1, c[k].y); y2 = std::max(y2, c[k].y);
+            }
+            return x2 >= -margin && x1 <= right && y2 >= -margin && y1 <= bottom;
+        };
+        size_t n = segments();
+        for (size_t first = 0; first < n; ) {
+            if (!visible(first)) {
+                first++;
+                continue;
+            }
+            size_t last = first + 1;
+            while (last < n && visible(last)) last++;
+            paint_segments(device, first, last);
+            first = last;
+        }
+    }
+
+    void Bezier::paint_segments(ImageDevice& device, size_t first, size_t last) {
+        if (antialias || stroke_width > 1.0f) {
+            std::vector<PointF> pts;
+            flatten_segments(first, last, pts);
+            paint_flattened(device, pts, color, antialias, stroke_width);
+            return;
+        }
+        auto setpixel = [&] (int x, int y) { device.setPixel(x, y, color); };
+        PointF start = points[3 * first];
+        setpixel((int)start.x, (int)start.y);
+        for (size_t i = first; i < last; i++) {
+            PointF c[4];
+            segment(i, c);
+            draw_curve_recursive(0.0f, 1.0f, c[0], c[3],
+                [&c] (float u) { return eval_cubic(c, u); }, setpixel);
+            if (i + 1 < last) setpixel(lround(c[3].x), lround(c[3].y));
+            else setpixel((int)c[3].x, (int)c[3].y);
+        }
+    }
+
     void Bezier::translate(float dx, float dy) {
         for (auto& p : points) p += PointF(dx, dy);
     }
@@ -138,6 +354,10 @@ namespace Paint {
             std::tie(p.x, p.y) = rel_mat_apply(x, y, p.x, p.y, mat);
     }
 
+    bool Bezier::bounds(PointF& min, PointF& max) const {
+        return stroke_bounds(points.data(), points.size(), min, max);
+    }
+
     void Bezier::scale(float x, float y, float s) {
         for (auto& p : points)
             std::tie(p.x, p.y) = rel_scale(x, y, p.x, p.y, s);
@@ -204,6 +424,11 @@ namespace Paint {
             std::tie(p.x, p.y) = rel_mat_apply(x, y, p.x, p.y, mat);
     }
 
+    // A B-spline lies within the convex hull of its control points.
+    bool BSpline::bounds(PointF& min, PointF& max) const {
+        return stroke_bounds(points.data(), points.size(), min, max);
+    }
+
     void BSpline::scale(float x, float y, float s) {
         for (auto& p : points)
             std::tie(p.x, p.y) = rel_scale(x, y, p.x, p.y, s);
@@ -0,0 +1,126 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <paint/paint.h>
+#include <paint/primitive.h>
+#include "algo.h"
+
+// Reads rows of the device a chunk at a time, so that scanning a run costs
+// one getHSpan per CHUNK pixels instead of one getPixel per pixel. Writes go
+// through the reader to keep the cached chunk up to date.
+class SpanReader {
+public:
+    static constexpr long CHUNK = 256;
+
+    explicit SpanReader(Paint::ImageDevice& device) :
+        device(device), width(device.getWidth()), chunk(CHUNK) { }
+
+    Paint::RGBColor at(long x, long y) {
+        if (y != cy || x < cx || x >= cx + clen) {
+            cy = y;
+            cx = x / CHUNK * CHUNK;
+            clen = std::min(CHUNK, width - cx);
+            device.getHSpan(cx, cy, clen, chunk.data());
+        }
+        return chunk[x - cx];
+    }
+
+    void set(long x1, long x2, long y, Paint::RGBColor color) {
+        device.setHSpan(x1, y, x2 - x1 + 1, color);
+        if (y == cy) {
+            long lo = std::max(x1, cx), hi = std::min(x2, cx + clen - 1);
+            for (long x = lo; x <= hi; x++) chunk[x - cx] = color;
+        }
+    }
+
+private:
+    Paint::ImageDevice& device;
+    long width;
+    long cy = -1, cx = 0, clen = 0;
+    std::vector<Paint::RGBColor> chunk;
+};
+
+constexpr long SpanReader::CHUNK;
+
+namespace Paint {
+
+    //
+    // class Fill : public Primitive
+    //
+
+    // Span filling with a stack of (x1, x2, y, dy) segments: row y between
+    // x1 and x2 is to be filled, having been reached from row y - dy. Each
+    // run is filled with one setHSpan, and only the parts of the parent row
+    // that the run overhangs are pushed back, so no pixel is tested more
+    // than a few times and the stack stays proportional to the boundary.
+    void Fill::paint(ImageDevice& device) {
+        long width = device.getWidth(), height = device.getHeight();
+        long sx = std::lround(seed.x), sy = std::lround(seed.y);
+        if (sx < 0 || sy < 0 || sx >= width || sy >= height) return;
+
+        SpanReader reader(device);
+        RGBColor target = reader.at(sx, sy);
+        if (target == color) return;
+        auto inside = [&] (long x, long y) {
+            return x >= 0 && x < width && y >= 0 && y < height &&
+                   reader.at(x, y) == target;
+        };
+
+        struct Segment { long x1, x2, y, dy; };
+        std::vector<Segment> stack = { { sx, sx, sy, 1 }, { sx, sx, sy - 1, -1 } };
+        while (!stack.empty()) {
+            Segment seg = stack.back();
+            stack.pop_back();
+            long x1 = seg.x1, x2 = seg.x2, y = seg.y, dy = seg.dy;
+            if (y < 0 || y >= height) continue;
+            long x = x1;
+            if (inside(x, y)) {
+                while (inside(x - 1, y)) x--;
+                if (x < x1) {
+                    reader.set(x, x1 - 1, y, color);
+                    stack.push_back({ x, x1 - 1, y - dy, -dy });
+                }
+            }
+            while (x1 <= x2) {
+                long start = x1;
+                while (inside(x1, y)) x1++;
+                if (x1 > start) reader.set(start, x1 - 1, y, color);
+                if (x1 > x) stack.push_back({ x, x1 - 1, y + dy, dy });
+                if (x1 - 1 > x2) stack.push_back({ x2 + 1, x1 - 1, y - dy, -dy });
+                x1++;
+                while (x1 < x2 && !inside(x1, y)) x1++;
+                x = x1;
+            }
+        }
+    }
+
+    void Fill::rotate(float x, float y, float rdeg) {
+        float mat[2][2];
+        init_rotate_matrix(rdeg, mat);
+        std::tie(seed.x, seed.y) = rel_mat_apply(x, y, seed.x, seed.y, mat);
+    }
+
+    void Fill::scale(float x, float y, float s) {
+        std::tie(seed.x, seed.y) = rel_scale(x, y, seed.x, seed.y, s);
+    }
+}
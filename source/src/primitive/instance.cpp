@@ -0,0 +1,144 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <cmath>
+#include <tuple>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <paint/paint.h>
+#include <paint/primitive.h>
+#include "algo.h"
+
+namespace Paint {
+
+    //
+    // class Shape
+    //
+
+    Shape::Shape(Primitive *prototype) : prototype(prototype) {
+        std::vector<PointF> points;
+        switch (prototype->type()) {
+        case Primitive::Type::Polygon:
+            for (auto& p : static_cast<Polygon*>(prototype)->points)
+                points.emplace_back(p.first, p.second);
+            break;
+        case Primitive::Type::Bezier:
+            points = static_cast<Bezier*>(prototype)->points;
+            flattened = static_cast<ParametricCurve*>(prototype)->flatten();
+            break;
+        case Primitive::Type::BSpline:
+            points = static_cast<BSpline*>(prototype)->points;
+            flattened = static_cast<ParametricCurve*>(prototype)->flatten();
+            break;
+        default:
+            throw std::invalid_argument("shapes must be polygons or curves");
+        }
+        if (!points.empty()) min = max = points[0];
+        for (PointF p : points) {
+            min.x = std::min(min.x, p.x); max.x = std::max(max.x, p.x);
+            min.y = std::min(min.y, p.y); max.y = std::max(max.y, p.y);
+        }
+    }
+
+    //
+    // class Instance : public Primitive
+    //
+
+    // An instance paints like its shape drawn at the transformed points.
+    // Anti-aliased and wide curves are painted from the shared flattening
+    // instead, as long as the transform does not magnify it beyond the
+    // flattening tolerance.
+    void Instance::paint(ImageDevice& device) {
+        const Primitive& proto = shape->get_prototype();
+        auto transformed = [this] (const std::vector<PointF>& points) {
+            std::vector<PointF> pts;
+            pts.reserve(points.size());
+            for (PointF p : points) pts.push_back(apply(p));
+            return pts;
+        };
+        std::unique_ptr<Primitive> prim;
+        switch (proto.type()) {
+        case Type::Polygon: {
+            auto& polygon = static_cast<const Polygon&>(proto);
+            std::vector<std::pair<float, float>> pts;
+            pts.reserve(polygon.points.size());
+            for (auto& p : polygon.points) {
+                PointF q = apply(PointF(p.first, p.second));
+                pts.emplace_back(q.x, q.y);
+            }
+            prim.reset(new Polygon(std::move(pts), color, polygon.algo));
+            break;
+        }
+        case Type::Bezier:
+        case Type::BSpline:
+            if ((antialias || stroke_width > 1.0f) &&
+                std::hypot(mat[0][0], mat[1][0]) <= 1.0f) {
+                ParametricCurve::paint_flattened(device, transformed(shape->get_flattened()),
+                                                 color, antialias, stroke_width);
+                return;
+            }
+            if (proto.type() == Type::Bezier) {
+                auto& bezier = static_cast<const Bezier&>(proto);
+                prim.reset(new Bezier(transformed(bezier.points), color, bezier.piecewise));
+            } else {
+                auto& bspline = static_cast<const BSpline&>(proto);
+                auto curve = new BSpline(transformed(bspline.points), color, bspline.order);
+                curve->set_knot(bspline.get_knot());
+                prim.reset(curve);
+            }
+            break;
+        default:
+            throw std::logic_error("invalid shape");
+        }
+        prim->set_antialias(antialias);
+        prim->set_stroke_width(stroke_width);
+        prim->paint(device);
+    }
+
+    // The transformed corners of the shape's box enclose the transformed
+    // shape.
+    bool Instance::bounds(PointF& min, PointF& max) const {
+        PointF lo = shape->get_min(), hi = shape->get_max();
+        const PointF corners[4] = { apply(lo), apply(PointF(hi.x, lo.y)),
+                                    apply(PointF(lo.x, hi.y)), apply(hi) };
+        return stroke_bounds(corners, 4, min, max);
+    }
+
+    // Rotation and scaling about (x, y) are composed with the transform
+    // the same way Polygon applies them to its points.
+    void Instance::rotate(float x, float y, float rdeg) {
+        float rot[2][2], res[2][2];
+        init_rotate_matrix(rdeg, rot);
+        for (int i = 0; i < 2; i++)
+            for (int j = 0; j < 2; j++)
+                res[i][j] = rot[i][0] * mat[0][j] + rot[i][1] * mat[1][j];
+        std::copy(&res[0][0], &res[0][0] + 4, &mat[0][0]);
+        std::tie(offset.x, offset.y) = rel_mat_apply(x, y, offset.x, offset.y, rot);
+    }
+
+    void Instance::scale(float x, float y, float s) {
+        for (auto& row : mat)
+            for (float& v : row) v *= s;
+        std::tie(offset.x, offset.y) = rel_scale(x, y, offset.x, offset.y, s);
+    }
+}
@@ -18,12 +18,18 @@
 
 #include <cmath>
 #include <utility>
+#include <algorithm>
 #include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <paint/paint.h>
 #include <paint/primitive.h>
 #include <paint/util.h>
 #include "algo.h"
+#include "coverage.h"
+#include "stroke.h"
 
 using std::lround;          // from <cmath>
 using std::abs; 
@@ -51,6 +57,104 @@ static void DrawLine_DDA(Paint::ImageDevice& device, Paint::RGBColor color,
     }
 }
 
+// 32.32 fixed-point DDA. The minor coordinate of step k is
+// floor(m0 + 1/2 + k * slope), with the slope taken from the rounded end
+// points so the walk always lands on the last pixel. Coordinates are
+// produced DDA_BLOCK at a time and consecutive pixels on the same row or
+// column are written as one span.
+static constexpr int FIXED_SHIFT = 32;
+static constexpr int DDA_BLOCK = 8;
+// Keeps accumulators non-negative so they can be shifted as unsigned.
+static constexpr long long FIXED_BIAS = 2LL * Paint::MAX_COORDINATE;
+
+static inline void dda_block(long long acc, long long step, int minor[DDA_BLOCK]) {
+    unsigned long long a = acc + (FIXED_BIAS << FIXED_SHIFT);
+#ifdef __SSE2__
+    __m128i va = _mm_set_epi64x(a + step, a), vstep = _mm_set1_epi64x(2 * step);
+    for (int k = 0; k < DDA_BLOCK; k += 2) {
+        __m128i hi = _mm_shuffle_epi32(_mm_srli_epi64(va, FIXED_SHIFT),
+                                       _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(minor + k), hi);
+        va = _mm_add_epi64(va, vstep);
+    }
+    for (int k = 0; k < DDA_BLOCK; k++) minor[k] -= FIXED_BIAS;
+#else
+    for (int k = 0; k < DDA_BLOCK; k++)
+        minor[k] = int((a + k * step) >> FIXED_SHIFT) - FIXED_BIAS;
+#endif
+}
+
+// Walks n + 1 pixels from minor coordinate m0 with the given fixed-point
+// step, reporting runs as emit(first_step, length, minor).
+template <typename T>
+static void fixed_dda_runs(int n, int m0, long long step, T&& emit) {
+    long long acc = ((long long)m0 << FIXED_SHIFT) + (1LL << (FIXED_SHIFT - 1));
+    int minor[DDA_BLOCK];
+    int run_start = 0, run_minor = m0;
+    for (int k = 0; k <= n; k += DDA_BLOCK, acc += DDA_BLOCK * step) {
+        dda_block(acc, step, minor);
+        int len = std::min(DDA_BLOCK, n + 1 - k);
+        for (int i = 0; i < len; i++) {
+            if (minor[i] != run_minor) {
+                emit(run_start, k + i - run_start, run_minor);
+                run_start = k + i;
+                run_minor = minor[i];
+            }
+        }
+    }
+    emit(run_start, n + 1 - run_start, run_minor);
+}
+
+static void DrawLine_FixedDDA(Paint::ImageDevice& device, Paint::RGBColor color,
+        float x1, float y1, float x2, float y2) {
+    int ix1 = limit_range(x1, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE), 
+        iy1 = limit_range(y1, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE), 
+        ix2 = limit_range(x2, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE), 
+        iy2 = limit_range(y2, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE);
+    if (ix1 == ix2 && iy1 == iy2) {
+        device.setPixel(ix1, iy1, color);
+    } else if (abs(ix1 - ix2) > abs(iy1 - iy2)) {
+        if (ix1 > ix2) { swap(ix1, ix2); swap(iy1, iy2); };
+        long long step = ((long long)(iy2 - iy1) << FIXED_SHIFT) / (ix2 - ix1);
+        fixed_dda_runs(ix2 - ix1, iy1, step, [&] (int k, int len, int y) {
+            device.setHSpan(ix1 + k, y, len, color);
+        });
+    } else {
+        if (iy1 > iy2) { swap(ix1, ix2); swap(iy1, iy2); };
+        long long step = ((long long)(ix2 - ix1) << FIXED_SHIFT) / (iy2 - iy1);
+        fixed_dda_runs(iy2 - iy1, ix1, step, [&] (int k, int len, int x) {
+            device.setVSpan(x, iy1 + k, len, color);
+        });
+    }
+}
+
+// Walks n steps along the major axis, advancing the minor axis whenever the
+// decision variable (starting from f0 <= 0, updated by 2m - 2n or 2m) is
+// non-negative. After step k the minor offset is
+//      c(k) = max(0, floor((f0 + 2mk) / 2n) + 1),
+// so offset v >= 1 starts at step ceil((2n(v-1) - f0) / 2m). Instead of
+// deciding per pixel, each run of steps sharing an offset is reported as
+// emit(first_step, length, offset).
+template <typename T>
+static void bresenham_runs(long long n, long long m, long long f0, T&& emit) {
+    if (m == 0) {
+        emit(0LL, n, f0 >= 0 ? 1LL : 0LL);
+        return;
+    }
+    long long d = 2 * m, q = -f0 / d, r = -f0 % d;
+    long long dq = 2 * n / d, dr = 2 * n % d;
+    long long start = 0;
+    for (long long v = 0; start < n; v++) {
+        long long next = std::min(q + (r > 0), n);
+        if (next > start) {
+            emit(start, next - start, v);
+            start = next;
+        }
+        q += dq; r += dr;
+        if (r >= d) { q++; r -= d; }
+    }
+}
+
 static void DrawLine_Bresenham(Paint::ImageDevice& device, Paint::RGBColor color,
         float x1, float y1, float x2, float y2) {
     int ix1 = limit_range(x1, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE), 
@@ -64,42 +168,333 @@ static void DrawLine_Bresenham(Paint::ImageDevice& device, Paint::RGBColor color
         if (ix1 > ix2) { swap(ix1, ix2); swap(iy1, iy2); }
         if (iy1 > iy2) { iy1 = -iy1; iy2 = -iy2; negate = true; }
         int dx = ix2 - ix1, dy = iy2 - iy1;
-        long long f = -dx;
         device.setPixel(ix1, negate ? -iy1 : iy1, color);
-        for (int x = ix1, y = iy1; x < ix2; x++) {
-            if (f >= 0) { y++; f -= dx; } else { f += dx; }
-            device.setPixel(x, negate ? -y : y, color);
-            f += dy + dy - dx;
-        }
+        bresenham_runs(dx, dy, -dx, [&] (long long k, long long len, long long v) {
+            int y = iy1 + v;
+            device.setHSpan(ix1 + k, negate ? -y : y, len, color);
+        });
     } else {
         bool negate = false;
         if (iy1 > iy2) { swap(ix1, ix2); swap(iy1, iy2); }
         if (ix1 > ix2) { ix1 = -ix1; ix2 = -ix2; negate = true; }
         int dy = iy2 - iy1, dx = ix2 - ix1;
-        long long f = -dx;
         device.setPixel(negate ? -ix1 : ix1, iy1, color);
-        for (int y = iy1, x = ix1; y < iy2; y++) { 
-            if (f >= 0) { x++; f -= dy; } else { f += dy; }
-            device.setPixel(negate ? -x : x, y, color);
-            f += dx + dx - dy;
+        bresenham_runs(dy, dx, -dx, [&] (long long k, long long len, long long v) {
+            int x = ix1 + v;
+            device.setVSpan(negate ? -x : x, iy1 + k, len, color);
+        });
+    }
+}
+
+//
+// Batched rasterization of short lines. Up to LINE_LANES consecutive lines
+// sharing an algorithm are set up and stepped together, one per SIMD lane.
+// The minor coordinates of every lane are buffered and then written out
+// line by line, so the result is the same as painting the lines in order.
+//
+static constexpr int LINE_LANES = 4;
+static constexpr int LANE_PIXELS = 64;
+
+struct LineLanes {
+    int major0[LINE_LANES], minor0[LINE_LANES];
+    int n[LINE_LANES], m[LINE_LANES];   // major length, signed minor delta
+    int xmajor[LINE_LANES];             // all ones when x is the major axis
+    float slope[LINE_LANES];            // DDA only
+    int minor[LANE_PIXELS + 1][LINE_LANES];
+};
+
+#ifdef __SSE2__
+static inline __m128i blend(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128 blend(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Rounds half away from zero like std::round, exact for |v| < 2^23.
+static inline __m128i round_lanes(__m128 v) {
+    __m128i t = _mm_cvttps_epi32(v);
+    __m128 frac = _mm_sub_ps(v, _mm_cvtepi32_ps(t));
+    t = _mm_sub_epi32(t, _mm_castps_si128(_mm_cmpge_ps(frac, _mm_set1_ps(0.5f))));
+    return _mm_add_epi32(t, _mm_castps_si128(_mm_cmple_ps(frac, _mm_set1_ps(-0.5f))));
+}
+#endif
+
+// Rounds and range checks the end points the way limit_range does and
+// orients every lane along its major axis. Returns false if an end point
+// is out of range; the caller then paints the lines one by one so that
+// the exception is raised by the offending line.
+static bool setup_lanes(LineLanes& g, Paint::Line* const* lines, int count) {
+    alignas(16) float x1[LINE_LANES] = {}, y1[LINE_LANES] = {},
+                      x2[LINE_LANES] = {}, y2[LINE_LANES] = {};
+    for (int i = 0; i < count; i++) {
+        x1[i] = lines[i]->p1.x; y1[i] = lines[i]->p1.y;
+        x2[i] = lines[i]->p2.x; y2[i] = lines[i]->p2.y;
+    }
+#ifdef __SSE2__
+    __m128 fx1 = _mm_load_ps(x1), fy1 = _mm_load_ps(y1),
+           fx2 = _mm_load_ps(x2), fy2 = _mm_load_ps(y2);
+    __m128 lo = _mm_set1_ps(Paint::MIN_COORDINATE), hi = _mm_set1_ps(Paint::MAX_COORDINATE);
+    __m128 bad = _mm_setzero_ps();
+    for (__m128 v : { fx1, fy1, fx2, fy2 })
+        bad = _mm_or_ps(bad, _mm_or_ps(_mm_cmplt_ps(v, lo), _mm_cmpgt_ps(v, hi)));
+    if (_mm_movemask_ps(bad)) return false;
+
+    __m128i ix1 = round_lanes(fx1), iy1 = round_lanes(fy1),
+            ix2 = round_lanes(fx2), iy2 = round_lanes(fy2);
+    __m128i dx = _mm_sub_epi32(ix2, ix1), dy = _mm_sub_epi32(iy2, iy1);
+    __m128i sx = _mm_srai_epi32(dx, 31), sy = _mm_srai_epi32(dy, 31);
+    __m128i adx = _mm_sub_epi32(_mm_xor_si128(dx, sx), sx),
+            ady = _mm_sub_epi32(_mm_xor_si128(dy, sy), sy);
+    __m128i xmajor = _mm_cmpgt_epi32(adx, ady);
+    __m128i maj1 = blend(xmajor, ix1, iy1), min1 = blend(xmajor, iy1, ix1),
+            maj2 = blend(xmajor, ix2, iy2), min2 = blend(xmajor, iy2, ix2);
+    __m128i swapped = _mm_cmpgt_epi32(maj1, maj2);
+    __m128i major0 = blend(swapped, maj2, maj1), minor0 = blend(swapped, min2, min1);
+    __m128i n = _mm_sub_epi32(blend(swapped, maj1, maj2), major0),
+            m = _mm_sub_epi32(blend(swapped, min1, min2), minor0);
+    __m128 ddx = _mm_sub_ps(fx2, fx1), ddy = _mm_sub_ps(fy2, fy1);
+    __m128 slope = blend(_mm_castsi128_ps(xmajor),
+                          _mm_div_ps(ddy, ddx), _mm_div_ps(ddx, ddy));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(g.major0), major0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(g.minor0), minor0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(g.n), n);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(g.m), m);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(g.xmajor), xmajor);
+    _mm_storeu_ps(g.slope, slope);
+#else
+    for (int i = 0; i < LINE_LANES; i++) {
+        for (float v : { x1[i], y1[i], x2[i], y2[i] })
+            if (v < Paint::MIN_COORDINATE || v > Paint::MAX_COORDINATE) return false;
+        int ix1 = std::round(x1[i]), iy1 = std::round(y1[i]),
+            ix2 = std::round(x2[i]), iy2 = std::round(y2[i]);
+        bool xmajor = abs(ix2 - ix1) > abs(iy2 - iy1);
+        if (!xmajor) { swap(ix1, iy1); swap(ix2, iy2); }
+        if (ix1 > ix2) { swap(ix1, ix2); swap(iy1, iy2); }
+        g.major0[i] = ix1; g.minor0[i] = iy1;
+        g.n[i] = ix2 - ix1; g.m[i] = iy2 - iy1;
+        g.xmajor[i] = xmajor ? -1 : 0;
+        g.slope[i] = xmajor ? (y2[i] - y1[i]) / (x2[i] - x1[i])
+                            : (x2[i] - x1[i]) / (y2[i] - y1[i]);
+    }
+#endif
+    return true;
+}
+
+// Minor coordinates of the float DDA: lround of the running sum
+// minor0 + k * slope, accumulated exactly as DrawLine_DDA does.
+static void step_lanes_DDA(LineLanes& g, int len) {
+#ifdef __SSE2__
+    __m128 y = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i*>(g.minor0)));
+    __m128 slope = _mm_loadu_ps(g.slope);
+    for (int k = 0; k < len; k++, y = _mm_add_ps(y, slope))
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(g.minor[k]), round_lanes(y));
+#else
+    for (int i = 0; i < LINE_LANES; i++) {
+        float y = g.minor0[i];
+        for (int k = 0; k < len; k++, y += g.slope[i])
+            g.minor[k][i] = lround(y);
+    }
+#endif
+}
+
+// Minor coordinates of the fixed-point DDA, see fixed_dda_runs.
+static void step_lanes_FixedDDA(LineLanes& g, int len) {
+    alignas(16) long long acc[LINE_LANES], step[LINE_LANES];
+    for (int i = 0; i < LINE_LANES; i++) {
+        step[i] = g.n[i] ? ((long long)g.m[i] << FIXED_SHIFT) / g.n[i] : 0;
+        acc[i] = ((long long)(g.minor0[i] + FIXED_BIAS) << FIXED_SHIFT)
+               + (1LL << (FIXED_SHIFT - 1));
+    }
+#ifdef __SSE2__
+    __m128i a01 = _mm_load_si128(reinterpret_cast<__m128i*>(acc)),
+            a23 = _mm_load_si128(reinterpret_cast<__m128i*>(acc + 2)),
+            s01 = _mm_load_si128(reinterpret_cast<__m128i*>(step)),
+            s23 = _mm_load_si128(reinterpret_cast<__m128i*>(step + 2)),
+            bias = _mm_set1_epi32(FIXED_BIAS);
+    for (int k = 0; k < len; k++) {
+        __m128i h01 = _mm_shuffle_epi32(_mm_srli_epi64(a01, FIXED_SHIFT), _MM_SHUFFLE(3, 1, 2, 0)),
+                h23 = _mm_shuffle_epi32(_mm_srli_epi64(a23, FIXED_SHIFT), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(g.minor[k]),
+                         _mm_sub_epi32(_mm_unpacklo_epi64(h01, h23), bias));
+        a01 = _mm_add_epi64(a01, s01);
+        a23 = _mm_add_epi64(a23, s23);
+    }
+#else
+    for (int i = 0; i < LINE_LANES; i++)
+        for (int k = 0; k < len; k++)
+            g.minor[k][i] = int((unsigned long long)(acc[i] + k * step[i]) >> FIXED_SHIFT)
+                          - FIXED_BIAS;
+#endif
+}
+
+// Minor coordinates of Bresenham's algorithm for steps 0 .. n - 1, with the
+// same decision variable as DrawLine_Bresenham (which starts from -dx on
+// both axes); the first end point is written separately.
+static void step_lanes_Bresenham(LineLanes& g, int len) {
+#ifdef __SSE2__
+    __m128i n = _mm_loadu_si128(reinterpret_cast<__m128i*>(g.n)),
+            m = _mm_loadu_si128(reinterpret_cast<__m128i*>(g.m)),
+            minor = _mm_loadu_si128(reinterpret_cast<__m128i*>(g.minor0)),
+            xmajor = _mm_loadu_si128(reinterpret_cast<__m128i*>(g.xmajor));
+    __m128i sign = _mm_srai_epi32(m, 31), am = _mm_sub_epi32(_mm_xor_si128(m, sign), sign);
+    __m128i f = _mm_sub_epi32(_mm_setzero_si128(), blend(xmajor, n, am));
+    __m128i up = _mm_add_epi32(am, am), diag = _mm_sub_epi32(up, _mm_add_epi32(n, n));
+    __m128i c = _mm_setzero_si128(), none = _mm_set1_epi32(-1);
+    for (int k = 0; k < len; k++) {
+        __m128i mask = _mm_cmpgt_epi32(f, none);
+        c = _mm_sub_epi32(c, mask);
+        f = _mm_add_epi32(f, blend(mask, diag, up));
+        __m128i offset = _mm_sub_epi32(_mm_xor_si128(c, sign), sign);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(g.minor[k]), _mm_add_epi32(minor, offset));
+    }
+#else
+    for (int i = 0; i < LINE_LANES; i++) {
+        int am = abs(g.m[i]), sign = g.m[i] < 0 ? -1 : 1;
+        int f = g.xmajor[i] ? -g.n[i] : -am, c = 0;
+        for (int k = 0; k < len; k++) {
+            if (f >= 0) { c++; f += 2 * am - 2 * g.n[i]; } else { f += 2 * am; }
+            g.minor[k][i] = g.minor0[i] + sign * c;
         }
     }
+#endif
+}
+
+// Writes the buffered pixels of one lane as runs on its minor coordinate.
+static void emit_lane(Paint::ImageDevice& device, Paint::RGBColor color,
+        const LineLanes& g, int i, int len) {
+    bool xmajor = g.xmajor[i];
+    auto emit = [&] (int k, int run, int minor) {
+        if (xmajor) device.setHSpan(g.major0[i] + k, minor, run, color);
+        else device.setVSpan(minor, g.major0[i] + k, run, color);
+    };
+    int start = 0;
+    for (int k = 1; k < len; k++) {
+        if (g.minor[k][i] != g.minor[start][i]) {
+            emit(start, k - start, g.minor[start][i]);
+            start = k;
+        }
+    }
+    if (len > 0) emit(start, len - start, g.minor[start][i]);
+}
+
+static void DrawLine_AA(CoverageBuffer& cov, float x1, float y1, float x2, float y2,
+        bool caps) {
+    for (float v : { x1, y1, x2, y2 })
+        limit_range(v, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE);
+    wu_line(cov, x1, y1, x2, y2, caps);
 }
 
 namespace Paint {
+
+    //
+    // class Primitive
+    //
+
+    // Miters reach out MITER_LIMIT half widths at most; the extra two
+    // pixels cover rounding and anti-aliasing.
+    bool Primitive::stroke_bounds(const PointF *points, size_t n,
+                                  PointF& min, PointF& max) const {
+        if (n == 0) return false;
+        min = max = points[0];
+        for (size_t i = 1; i < n; i++) {
+            min.x = std::min(min.x, points[i].x); max.x = std::max(max.x, points[i].x);
+            min.y = std::min(min.y, points[i].y); max.y = std::max(max.y, points[i].y);
+        }
+        float margin = stroke_width * Stroker::MITER_LIMIT + 2.0f;
+        min -= PointF(margin, margin);
+        max += PointF(margin, margin);
+        return true;
+    }
+
     //
     // class Line : public Element
     //
     void Line::paint(ImageDevice& device) {
-        switch (algo) {
-        case Algorithm::DDA :
-            DrawLine_DDA(device, color, p1.x, p1.y, p2.x, p2.y);
-            break;
-        case Algorithm::Bresenham :
-            DrawLine_Bresenham(device, color, p1.x, p1.y, p2.x, p2.y);
-            break;
-        default:
-            throw std::invalid_argument("unknown algorithm"); 
+        if (stroke_width > 1.0f) {
+            Stroker stroker(stroke_width, antialias);
+            stroker.polyline({ p1, p2 }, false);
+            stroker.fill(device, color);
+            return;
+        }
+        if (antialias) {
+            CoverageBuffer cov(device);
+            DrawLine_AA(cov, p1.x, p1.y, p2.x, p2.y, true);
+            cov.blend(color);
+            return;
+        }
+        auto draw = [this] (ImageDevice& target) {
+            switch (algo) {
+            case Algorithm::DDA :
+                DrawLine_DDA(target, color, p1.x, p1.y, p2.x, p2.y);
+                break;
+            case Algorithm::Bresenham :
+                DrawLine_Bresenham(target, color, p1.x, p1.y, p2.x, p2.y);
+                break;
+            case Algorithm::FixedDDA :
+                DrawLine_FixedDDA(target, color, p1.x, p1.y, p2.x, p2.y);
+                break;
+            default:
+                throw std::invalid_argument("unknown algorithm"); 
+            }
+        };
+        // DDA accumulates the minor coordinate in floats starting from the
+        // first end point, so its raster does not shift exactly.
+        if (raster_cache && algo != Algorithm::DDA)
+            raster_cache->paint(device, color, { p1, p2 }, { float(algo) }, draw);
+        else
+            draw(device);
+    }
+    
+    void Line::paint_batch(ImageDevice& device, Line* const* lines, size_t n) {
+        LineLanes g;
+        // Anti-aliased and wide lines have their own rasterizers, and cached
+        // lines are replayed from their cache.
+        auto plain = [] (const Line *line) {
+            return !line->antialias && line->stroke_width <= 1.0f &&
+                   !line->raster_cache;
+        };
+        for (size_t i = 0; i < n; ) {
+            if (!plain(lines[i])) {
+                lines[i++]->paint(device);
+                continue;
+            }
+            Algorithm algo = lines[i]->algo;
+            int count = 1;
+            while (count < LINE_LANES && i + count < n &&
+                   lines[i + count]->algo == algo && plain(lines[i + count]))
+                count++;
+            void (*step)(LineLanes&, int);
+            switch (algo) {
+            case Algorithm::DDA :       step = step_lanes_DDA; break;
+            case Algorithm::Bresenham : step = step_lanes_Bresenham; break;
+            case Algorithm::FixedDDA :  step = step_lanes_FixedDDA; break;
+            default:                    step = nullptr;
+            }
+            if (!step || !setup_lanes(g, lines + i, count)) {
+                for (int k = 0; k < count; k++) lines[i + k]->paint(device);
+                i += count;
+                continue;
+            }
+            // DDA kernels cover both end points, Bresenham stops one short.
+            int extra = algo == Algorithm::Bresenham ? 0 : 1, len = 0;
+            for (int k = 0; k < count; k++)
+                if (g.n[k] <= LANE_PIXELS) len = std::max(len, g.n[k] + extra);
+            step(g, len);
+            for (int k = 0; k < count; k++) {
+                Line& line = *lines[i + k];
+                if (g.n[k] > LANE_PIXELS) {
+                    line.paint(device);
+                    continue;
+                }
+                if (algo == Algorithm::Bresenham) {
+                    if (g.xmajor[k]) device.setPixel(g.major0[k], g.minor0[k], line.color);
+                    else device.setPixel(g.minor0[k], g.major0[k], line.color);
+                }
+                emit_lane(device, line.color, g, k, g.n[k] + extra);
+            }
+            i += count;
         }
     }
     
@@ -119,29 +514,59 @@ namespace Paint {
     // class Polygon : public Element
     //
     void Polygon::paint(ImageDevice& device) {
+        if (stroke_width > 1.0f) {
+            std::vector<PointF> pts;
+            pts.reserve(points.size());
+            for (auto& p : points) pts.emplace_back(p.first, p.second);
+            Stroker stroker(stroke_width, antialias);
+            stroker.polyline(pts, points.size() > 2);
+            stroker.fill(device, color);
+            return;
+        }
+        if (antialias) {
+            // Vertices are shared by two edges, so edges are not capped.
+            CoverageBuffer cov(device);
+            bool closed = points.size() > 2;
+            for (size_t i = 1; i < points.size(); i++)
+                DrawLine_AA(cov, points[i-1].first, points[i-1].second,
+                            points[i].first, points[i].second, !closed);
+            if (closed)
+                DrawLine_AA(cov, points.back().first, points.back().second,
+                            points.front().first, points.front().second, false);
+            cov.blend(color);
+            return;
+        }
+        void (*draw)(ImageDevice&, RGBColor, float, float, float, float);
         switch (algo) {
         case Line::Algorithm::DDA :
-            for (size_t i = 1; i < points.size(); i++)
-                DrawLine_DDA(device, color,
-                    points[i-1].first, points[i-1].second, 
-                    points[i].first, points[i].second);
-            if (points.size() > 2) 
-                DrawLine_DDA(device, color,
-                    points.back().first, points.back().second,
-                    points.front().first, points.front().second);
+            draw = DrawLine_DDA;
             break;
         case Line::Algorithm::Bresenham :
+            draw = DrawLine_Bresenham;
+            break;
+        case Line::Algorithm::FixedDDA :
+            draw = DrawLine_FixedDDA;
+            break;
+        default:
+            throw std::invalid_argument("unknown algorithm");
+        }
+        auto draw_edges = [&] (ImageDevice& target) {
             for (size_t i = 1; i < points.size(); i++)
-                DrawLine_Bresenham(device, color,
+                draw(target, color,
                     points[i-1].first, points[i-1].second, 
                     points[i].first, points[i].second);
             if (points.size() > 2) 
-                DrawLine_Bresenham(device, color,
+                draw(target, color,
                     points.back().first, points.back().second,
                     points.front().first, points.front().second);
-            break;
-        default:
-            throw std::invalid_argument("unknown algorithm");
+        };
+        if (raster_cache && algo != Line::Algorithm::DDA) {
+            std::vector<PointF> pts;
+            pts.reserve(points.size());
+            for (auto& p : points) pts.emplace_back(p.first, p.second);
+            raster_cache->paint(device, color, pts, { float(algo) }, draw_edges);
+        } else {
+            draw_edges(device);
         }
     }
     
@@ -152,6 +577,13 @@ namespace Paint {
             p = rel_mat_apply(x, y, p.first, p.second, mat);
     }
 
+    bool Polygon::bounds(PointF& min, PointF& max) const {
+        std::vector<PointF> pts;
+        pts.reserve(points.size());
+        for (auto& p : points) pts.emplace_back(p.first, p.second);
+        return stroke_bounds(pts.data(), pts.size(), min, max);
+    }
+
     void Polygon::scale(float x, float y, float s) {
         for (auto& p : points)
             p = rel_scale(x, y, p.first, p.second, s);
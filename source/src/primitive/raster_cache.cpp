@@ -0,0 +1,171 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include <paint/paint.h>
+#include <paint/primitive.h>
+
+// Bitmaps of cached rasters are limited to this many words; larger rasters
+// keep the spans as recorded.
+static constexpr size_t MAX_MASK_WORDS = size_t(1) << 22;
+
+static bool in_range(Paint::PointF p) {
+    return p.x >= Paint::MIN_COORDINATE && p.x <= Paint::MAX_COORDINATE &&
+           p.y >= Paint::MIN_COORDINATE && p.y <= Paint::MAX_COORDINATE;
+}
+
+static bool integral(const std::vector<Paint::PointF>& points) {
+    for (Paint::PointF p : points)
+        if (!in_range(p) || std::floor(p.x) != p.x || std::floor(p.y) != p.y)
+            return false;
+    return !points.empty();
+}
+
+namespace Paint {
+
+    // Records the writes of a rasterizer as spans.
+    class RasterCache::Recorder : public ImageDevice {
+    public:
+        Recorder(size_t width, size_t height, std::vector<Span>& spans) :
+            ImageDevice(width, height), spans(spans) { }
+
+        RGBColor getPixel(ssize_t x, ssize_t y) const override {
+            throw std::logic_error("cached rasters cannot read pixels");
+        }
+        void setPixel(ssize_t x, ssize_t y, RGBColor color) override {
+            spans.push_back({ int32_t(x), int32_t(y), 1, false });
+        }
+        void setHSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) override {
+            if (len) spans.push_back({ int32_t(x), int32_t(y), uint32_t(len), false });
+        }
+        void setVSpan(ssize_t x, ssize_t y, size_t len, RGBColor color) override {
+            if (len) spans.push_back({ int32_t(x), int32_t(y), uint32_t(len), true });
+        }
+
+    private:
+        std::vector<Span>& spans;
+    };
+
+    //
+    // class RasterCache
+    //
+    void RasterCache::paint(ImageDevice& device, RGBColor color,
+                            const std::vector<PointF>& points, const std::vector<float>& params,
+                            const std::function<void(ImageDevice&)>& rasterize) {
+        PointI shift;
+        if (!matches(points, params, shift)) {
+            spans.clear();
+            this->points.clear();
+            if (!integral(points)) {
+                rasterize(device);
+                return;
+            }
+            Recorder recorder(device.getWidth(), device.getHeight(), spans);
+            try {
+                rasterize(recorder);
+            } catch (...) {
+                replay(device, color, PointI());
+                spans.clear();
+                throw;
+            }
+            merge();
+            this->points = points;
+            this->params = params;
+        }
+        replay(device, color, shift);
+    }
+
+    // Whether the cached raster shifted by some integral shift is the raster
+    // of the given geometry. Out of range coordinates never match, so that
+    // painting them raises the usual error.
+    bool RasterCache::matches(const std::vector<PointF>& points,
+                              const std::vector<float>& params, PointI& shift) const {
+        if (this->points.empty() || points.size() != this->points.size() ||
+            params != this->params || !in_range(points[0]))
+            return false;
+        PointF d = points[0] - this->points[0];
+        if (std::floor(d.x) != d.x || std::floor(d.y) != d.y)
+            return false;
+        for (size_t i = 0; i < points.size(); i++) {
+            PointF p = points[i];
+            if (!in_range(p) || p.x != this->points[i].x + d.x ||
+                p.y != this->points[i].y + d.y)
+                return false;
+        }
+        shift = PointI(d.x, d.y);
+        return true;
+    }
+
+    // All spans have the same color and nothing is read back, so they may be
+    // replaced by the maximal horizontal runs of the pixels they cover, found
+    // through a bitmap of their bounding box. Overlapping edges are then
+    // written once and steep edges a row at a time.
+    void RasterCache::merge() {
+        if (spans.empty()) return;
+        int64_t x0 = INT64_MAX, y0 = INT64_MAX, x1 = INT64_MIN, y1 = INT64_MIN;
+        for (const Span& s : spans) {
+            x0 = std::min<int64_t>(x0, s.x);
+            y0 = std::min<int64_t>(y0, s.y);
+            x1 = std::max<int64_t>(x1, s.vertical ? s.x + 1 : int64_t(s.x) + s.len);
+            y1 = std::max<int64_t>(y1, s.vertical ? int64_t(s.y) + s.len : s.y + 1);
+        }
+        size_t stride = (x1 - x0 + 63) / 64, rows = y1 - y0;
+        if (stride * rows > MAX_MASK_WORDS) return;
+        std::vector<uint64_t> mask(stride * rows);
+        auto set = [&] (int64_t x, int64_t y) {
+            x -= x0;
+            mask[(y - y0) * stride + x / 64] |= uint64_t(1) << (x % 64);
+        };
+        for (const Span& s : spans)
+            for (uint32_t i = 0; i < s.len; i++)
+                if (s.vertical) set(s.x, int64_t(s.y) + i); else set(int64_t(s.x) + i, s.y);
+        spans.clear();
+        for (size_t r = 0; r < rows; r++) {
+            const uint64_t *row = &mask[r * stride];
+            size_t x = 0, end = stride * 64;
+            auto bit = [row] (size_t x) { return (row[x / 64] >> (x % 64)) & 1; };
+            while (x < end) {
+                if (!row[x / 64]) { x = (x / 64 + 1) * 64; continue; }
+                if (!bit(x)) { x++; continue; }
+                size_t start = x;
+                while (x < end && bit(x)) x++;
+                spans.push_back({ int32_t(x0 + start), int32_t(y0 + r),
+                                  uint32_t(x - start), false });
+            }
+        }
+        spans.shrink_to_fit();
+    }
+
+    void RasterCache::replay(ImageDevice& device, RGBColor color, PointI shift) const {
+        for (const Span& s : spans) {
+            ssize_t x = ssize_t(s.x) + shift.x, y = ssize_t(s.y) + shift.y;
+            if (s.len == 1)
+                device.setPixel(x, y, color);
+            else if (s.vertical)
+                device.setVSpan(x, y, s.len, color);
+            else
+                device.setHSpan(x, y, s.len, color);
+        }
+    }
+}
@@ -0,0 +1,211 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include <paint/paint.h>
+#include <paint/util.h>
+#include "stroke.h"
+
+using Paint::PointF;
+using util::limit_range;
+
+static inline float dot(PointF a, PointF b) { return a.x * b.x + a.y * b.y; }
+static inline float cross(PointF a, PointF b) { return a.x * b.y - a.y * b.x; }
+static inline PointF normal(PointF d) { return PointF(-d.y, d.x); }
+
+static inline void check_range(PointF p) {
+    limit_range(p.x, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE);
+    limit_range(p.y, Paint::MIN_COORDINATE, Paint::MAX_COORDINATE);
+}
+
+Stroker::Stroker(float width, bool antialias) :
+    half(width / 2.0f), samples(antialias ? SUBSAMPLES : 1) { }
+
+void Stroker::interval(long row, float x1, float x2) {
+    if (x1 <= x2) spans.push_back({ row, x1, x2 });
+}
+
+void Stroker::convex(const PointF *points, size_t n) {
+    float ymin = points[0].y, ymax = points[0].y;
+    for (size_t i = 1; i < n; i++) {
+        ymin = std::min(ymin, points[i].y);
+        ymax = std::max(ymax, points[i].y);
+    }
+    long first = std::ceil((ymin + 0.5f) * samples - 0.5f),
+         last = std::floor((ymax + 0.5f) * samples - 0.5f);
+    for (long row = first; row <= last; row++) {
+        float y = row_y(row), lo = INFINITY, hi = -INFINITY;
+        for (size_t i = 0; i < n; i++) {
+            PointF a = points[i], b = points[(i + 1) % n];
+            if (y < std::min(a.y, b.y) || y > std::max(a.y, b.y)) continue;
+            if (a.y == b.y) {
+                lo = std::min({ lo, a.x, b.x });
+                hi = std::max({ hi, a.x, b.x });
+            } else {
+                float x = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+                lo = std::min(lo, x);
+                hi = std::max(hi, x);
+            }
+        }
+        interval(row, lo, hi);
+    }
+}
+
+void Stroker::join(PointF p, PointF d0, PointF d1) {
+    float turn = cross(d0, d1), cosine = dot(d0, d1);
+    if (turn == 0.0f && cosine > 0.0f) return;
+    // The outer corner lies on the side the path turns away from.
+    float side = turn > 0.0f ? -half : half;
+    PointF n0 = normal(d0), n1 = normal(d1);
+    PointF piece[4] = { p, p + side * n0, p, p + side * n1 };
+    if (1.0f + cosine > 2.0f / (MITER_LIMIT * MITER_LIMIT)) {
+        piece[2] = p + (side / (1.0f + cosine)) * (n0 + n1);
+        convex(piece, 4);
+    } else {
+        piece[2] = piece[3];
+        convex(piece, 3);
+    }
+}
+
+void Stroker::polyline(const std::vector<PointF>& points, bool closed) {
+    std::vector<PointF> pts;
+    for (PointF p : points) {
+        check_range(p);
+        if (pts.empty() || p.x != pts.back().x || p.y != pts.back().y)
+            pts.push_back(p);
+    }
+    if (closed && pts.size() > 1 &&
+        pts.back().x == pts.front().x && pts.back().y == pts.front().y)
+        pts.pop_back();
+    if (pts.empty()) return;
+    if (pts.size() == 1) {
+        PointF p = pts[0], dx(half, 0.0f), dy(0.0f, half);
+        PointF square[4] = { p - dx - dy, p + dx - dy, p + dx + dy, p - dx + dy };
+        convex(square, 4);
+        return;
+    }
+    if (pts.size() == 2) closed = false;
+    size_t n = pts.size(), nsegs = closed ? n : n - 1;
+    std::vector<PointF> dir(nsegs);
+    for (size_t i = 0; i < nsegs; i++) {
+        PointF a = pts[i], b = pts[(i + 1) % n], d = b - a;
+        dir[i] = d * float(1.0 / d.abs());
+        PointF offset = half * normal(dir[i]);
+        PointF body[4] = { a + offset, b + offset, b - offset, a - offset };
+        convex(body, 4);
+    }
+    for (size_t i = closed ? 0 : 1; i < nsegs; i++)
+        join(pts[i], dir[(i + nsegs - 1) % nsegs], dir[i]);
+}
+
+void Stroker::ellipse(float x, float y, float rx, float ry) {
+    check_range(PointF(x, y));
+    check_range(PointF(rx, ry));
+    rx = std::fabs(rx); ry = std::fabs(ry);
+    float ox = rx + half, oy = ry + half, ix = rx - half, iy = ry - half;
+    long first = std::ceil((y - oy + 0.5f) * samples - 0.5f),
+         last = std::floor((y + oy + 0.5f) * samples - 0.5f);
+    for (long row = first; row <= last; row++) {
+        float dy = row_y(row) - y, t = dy / oy;
+        float a = ox * std::sqrt(std::max(0.0f, 1.0f - t * t));
+        if (ix > 0.0f && iy > 0.0f && std::fabs(dy) < iy) {
+            float u = dy / iy, b = ix * std::sqrt(std::max(0.0f, 1.0f - u * u));
+            interval(row, x - a, x - b);
+            interval(row, x + b, x + a);
+        } else {
+            interval(row, x - a, x + a);
+        }
+    }
+}
+
+void Stroker::fill(Paint::ImageDevice& device, Paint::RGBColor color) {
+    long width = device.getWidth(), height = device.getHeight();
+    std::sort(spans.begin(), spans.end(), [] (const Span& a, const Span& b) {
+        return a.row < b.row || (a.row == b.row && a.x1 < b.x1);
+    });
+    auto first = std::lower_bound(spans.begin(), spans.end(), 0L,
+        [] (const Span& s, long row) { return s.row < row; });
+
+    if (samples == 1) {
+        // Pixels whose centres lie in a span; adjacent runs are merged.
+        long row = -1, start = 0, end = -1;
+        auto flush = [&] {
+            if (start <= end) device.setHSpan(start, row, end - start + 1, color);
+        };
+        for (auto s = first; s != spans.end() && s->row < height; ++s) {
+            long x1 = std::max<float>(std::ceil(s->x1), 0.0f),
+                 x2 = std::min<float>(std::floor(s->x2), width - 1);
+            if (x1 > x2) continue;
+            if (s->row != row || x1 > end + 1) {
+                flush();
+                row = s->row; start = x1; end = x2;
+            } else {
+                end = std::max(end, x2);
+            }
+        }
+        flush();
+        spans.clear();
+        return;
+    }
+
+    // Coverage of one pixel row, from the merged intervals of its samples.
+    std::vector<float> coverage(width + 1, 0.0f);
+    auto s = first;
+    while (s != spans.end() && s->row / samples < height) {
+        long y = s->row / samples, xmin = width, xmax = -1;
+        while (s != spans.end() && s->row / samples == y) {
+            long row = s->row;
+            float a = s->x1, b = s->x2;
+            for (++s; ; ++s) {
+                if (s != spans.end() && s->row == row && s->x1 <= b) {
+                    b = std::max(b, s->x2);
+                    continue;
+                }
+                a = std::max(a, -0.5f);
+                b = std::min(b, width - 0.5f);
+                for (long x = std::floor(a + 0.5f); a < b; x++) {
+                    float right = std::min(b, x + 0.5f);
+                    coverage[x] += (right - a) / samples;
+                    xmin = std::min(xmin, x);
+                    xmax = std::max(xmax, x);
+                    a = right;
+                }
+                if (s == spans.end() || s->row != row) break;
+                a = s->x1; b = s->x2;
+            }
+        }
+        for (long x = xmin; x <= xmax; ) {
+            long run = x;
+            while (run <= xmax && coverage[run] >= 1.0f - 1e-4f) run++;
+            if (run > x) {
+                device.setHSpan(x, y, run - x, color);
+                std::fill(&coverage[x], &coverage[run], 0.0f);
+                x = run;
+                continue;
+            }
+            if (coverage[x] > 0.0f)
+                device.blendPixel(x, y, color, std::lround(std::min(coverage[x], 1.0f) * 255.0f));
+            coverage[x++] = 0.0f;
+        }
+    }
+    spans.clear();
+}
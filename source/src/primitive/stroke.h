@@ -0,0 +1,70 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SRC_PRIMITIVE_STROKE_H__
+#define __SRC_PRIMITIVE_STROKE_H__
+
+#include <vector>
+
+#include <paint/paint.h>
+#include <paint/device.h>
+
+// Span-based stroker for primitives wider than one pixel. Every piece of a
+// stroke (segment bodies, joins, elliptic rings) is convex or a difference
+// of two ellipses, so it covers one interval per scanline. The intervals of
+// all pieces are collected, merged per scanline and written as spans, so
+// overlapping pieces cost nothing extra and every pixel is written once.
+//
+// Aliased strokes sample scanlines at pixel centres and cover the pixels
+// whose centres lie inside. Anti-aliased strokes sample SUBSAMPLES lines per
+// pixel row and accumulate the exact horizontal overlap of each interval.
+class Stroker {
+public:
+    static constexpr int SUBSAMPLES = 4;
+    // Joins whose miter would be longer than MITER_LIMIT times the stroke
+    // width are beveled.
+    static constexpr float MITER_LIMIT = 4.0f;
+
+    Stroker(float width, bool antialias);
+
+    // Segments with butt caps, joined with miters. Closed polylines also
+    // join the last point to the first.
+    void polyline(const std::vector<Paint::PointF>& points, bool closed);
+    // The ring between the ellipses grown and shrunk by half the width.
+    void ellipse(float x, float y, float rx, float ry);
+
+    void fill(Paint::ImageDevice& device, Paint::RGBColor color);
+
+private:
+    struct Span {
+        long row;
+        float x1, x2;
+    };
+
+    void convex(const Paint::PointF *points, size_t n);
+    void join(Paint::PointF p, Paint::PointF d0, Paint::PointF d1);
+    void interval(long row, float x1, float x2);
+    float row_y(long row) const { return (row + 0.5f) / samples - 0.5f; }
+
+    float half;
+    int samples;
+    std::vector<Span> spans;
+};
+
+#endif
@@ -0,0 +1,345 @@
+/*
+    Paint, a simple rasterization tool
+    Copyright (C) 2019 Chen Shaoyuan
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <map>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include <paint/paint.h>
+#include <paint/primitive.h>
+#include <paint/snapshot.h>
+
+static const char SNAPSHOT_MAGIC[8] = { 'P', 'A', 'I', 'N', 'T', 'S', 'N', 'P' };
+static constexpr uint32_t SNAPSHOT_VERSION = 1;
+static constexpr size_t HEADER_SIZE = 28, RECORD_SIZE = 28;
+static constexpr uint8_t FLAG_ANTIALIAS = 1;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static constexpr bool NATIVE_LAYOUT = true;
+#else
+static constexpr bool NATIVE_LAYOUT = false;
+#endif
+
+static_assert(sizeof(Paint::PointF) == 2 * sizeof(float) &&
+              std::is_trivially_copyable<Paint::PointF>::value,
+              "PointF must be two packed floats");
+
+static inline void put_u32(std::string& out, uint32_t val) {
+    for (int i = 0; i < 4; i++) out.push_back(char(val >> (8 * i)));
+}
+
+static inline void put_f32(std::string& out, float val) {
+    uint32_t bits;
+    std::memcpy(&bits, &val, sizeof(bits));
+    put_u32(out, bits);
+}
+
+static inline uint32_t get_u32(const char *buf) {
+    uint32_t val = 0;
+    for (int i = 0; i < 4; i++) val |= uint32_t(uint8_t(buf[i])) << (8 * i);
+    return val;
+}
+
+static inline float get_f32(const char *buf) {
+    uint32_t bits = get_u32(buf);
+    float val;
+    std::memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+static void put_floats(std::string& out, const float *vals, size_t n) {
+    if (NATIVE_LAYOUT) {
+        out.append(reinterpret_cast<const char*>(vals), n * sizeof(float));
+    } else {
+        for (size_t i = 0; i < n; i++) put_f32(out, vals[i]);
+    }
+}
+
+static void get_floats(const char *buf, float *vals, size_t n) {
+    if (NATIVE_LAYOUT) {
+        std::memcpy(vals, buf, n * sizeof(float));
+    } else {
+        for (size_t i = 0; i < n; i++) vals[i] = get_f32(buf + 4 * i);
+    }
+}
+
+[[noreturn]] static void malformed() {
+    throw std::runtime_error("malformed snapshot");
+}
+
+namespace Paint {
+
+    // Appends the record of prim; instances refer to their shape by its id
+    // in shape_ids.
+    static void encode_record(std::string& out, int id, const Primitive& prim,
+                              const std::map<const Shape*, int>& shape_ids) {
+        uint8_t algo = 0;
+        uint32_t order = 0;
+        std::vector<PointF> points;
+        const std::vector<float> *knot = nullptr;
+        switch (prim.type()) {
+        case Primitive::Type::Line: {
+            auto& line = static_cast<const Line&>(prim);
+            algo = uint8_t(line.algo);
+            points = { line.p1, line.p2 };
+            break;
+        }
+        case Primitive::Type::Polygon: {
+            auto& polygon = static_cast<const Polygon&>(prim);
+            algo = uint8_t(polygon.algo);
+            points.reserve(polygon.points.size());
+            for (auto& p : polygon.points)
+                points.emplace_back(p.first, p.second);
+            break;
+        }
+        case Primitive::Type::Ellipse: {
+            auto& ellipse = static_cast<const Ellipse&>(prim);
+            points = { PointF(ellipse.x, ellipse.y),
+                       PointF(ellipse.rx, ellipse.ry) };
+            break;
+        }
+        case Primitive::Type::Bezier: {
+            auto& bezier = static_cast<const Bezier&>(prim);
+            algo = bezier.piecewise;
+            points = bezier.points;
+            break;
+        }
+        case Primitive::Type::Fill:
+            points = { static_cast<const Fill&>(prim).seed };
+            break;
+        case Primitive::Type::BSpline: {
+            auto& bspline = static_cast<const BSpline&>(prim);
+            order = bspline.order;
+            points = bspline.points;
+            knot = &bspline.get_knot();
+            break;
+        }
+        case Primitive::Type::Instance: {
+            auto& instance = static_cast<const Instance&>(prim);
+            order = uint32_t(shape_ids.at(instance.shape.get()));
+            points = { PointF(instance.mat[0][0], instance.mat[1][0]),
+                       PointF(instance.mat[0][1], instance.mat[1][1]),
+                       instance.offset };
+            break;
+        }
+        }
+        RGBColor color = prim.get_color();
+        uint8_t flags = prim.get_antialias() ? FLAG_ANTIALIAS : 0;
+        const char rec[8] = { char(prim.type()), char(algo),
+            char(color.red), char(color.green), char(color.blue), char(flags) };
+        out.append(rec, sizeof(rec));
+        put_u32(out, id);
+        put_u32(out, order);
+        put_u32(out, points.size());
+        put_u32(out, knot ? knot->size() : 0);
+        put_f32(out, prim.get_stroke_width());
+        put_floats(out, reinterpret_cast<const float*>(points.data()),
+                   points.size() * 2);
+        if (knot) put_floats(out, knot->data(), knot->size());
+    }
+
+    // Decodes the record at pos and advances pos past it. Instances look
+    // their shape up in shapes.
+    static std::unique_ptr<Primitive> decode_record(const char *&pos, const char *end,
+            const ShapeMap& shapes, int& id) {
+        if (size_t(end - pos) < RECORD_SIZE) malformed();
+        auto type = Primitive::Type(uint8_t(pos[0]));
+        uint8_t algo = pos[1];
+        RGBColor color(pos[2], pos[3], pos[4]);
+        uint8_t flags = pos[5];
+        id = int32_t(get_u32(pos + 8));
+        uint32_t order = get_u32(pos + 12),
+                 npoints = get_u32(pos + 16),
+                 nknots = get_u32(pos + 20);
+        float stroke_width = get_f32(pos + 24);
+        pos += RECORD_SIZE;
+        size_t avail = (end - pos) / 4;
+        if (nknots > avail || (avail - nknots) / 2 < npoints)
+            malformed();
+        std::vector<PointF> points(npoints);
+        get_floats(pos, reinterpret_cast<float*>(points.data()), npoints * 2);
+        pos += npoints * 8;
+        std::vector<float> knot(nknots);
+        get_floats(pos, knot.data(), nknots);
+        pos += nknots * 4;
+
+        if (algo > uint8_t(Line::Algorithm::FixedDDA) || (flags & ~FLAG_ANTIALIAS) ||
+            !(stroke_width >= 1.0f && stroke_width <= MAX_STROKE_WIDTH))
+            malformed();
+        std::unique_ptr<Primitive> prim;
+        switch (type) {
+        case Primitive::Type::Line:
+            if (npoints != 2) malformed();
+            prim.reset(new Line(points[0], points[1], color, Line::Algorithm(algo)));
+            break;
+        case Primitive::Type::Polygon: {
+            if (npoints < 2) malformed();
+            std::vector<std::pair<float, float>> pts;
+            pts.reserve(npoints);
+            for (auto& p : points) pts.emplace_back(p.x, p.y);
+            prim.reset(new Polygon(std::move(pts), color, Line::Algorithm(algo)));
+            break;
+        }
+        case Primitive::Type::Ellipse:
+            if (npoints != 2) malformed();
+            prim.reset(new Ellipse(points[0].x, points[0].y,
+                                   points[1].x, points[1].y, color));
+            break;
+        case Primitive::Type::Bezier:
+            if (algo > 1 || npoints < 2) malformed();
+            prim.reset(new Bezier(std::move(points), color, algo));
+            break;
+        case Primitive::Type::Fill:
+            if (npoints != 1) malformed();
+            prim.reset(new Fill(points[0], color));
+            break;
+        case Primitive::Type::BSpline: {
+            if (npoints < 2 || order < 1 ||
+                nknots != (npoints <= order ? 0 : npoints + order + 1))
+                malformed();
+            // knots must be sorted within [0, 1], as update_knot makes them
+            for (size_t i = 0; i < nknots; i++)
+                if (!(knot[i] >= (i ? knot[i - 1] : 0.0f) && knot[i] <= 1.0f))
+                    malformed();
+            auto bspline = new BSpline(std::move(points), color, order);
+            bspline->set_knot(std::move(knot));
+            prim.reset(bspline);
+            break;
+        }
+        case Primitive::Type::Instance: {
+            auto shape = shapes.find(int32_t(order));
+            if (npoints != 3 || shape == shapes.end()) malformed();
+            auto instance = new Instance(shape->second, color, points[2]);
+            instance->mat[0][0] = points[0].x; instance->mat[1][0] = points[0].y;
+            instance->mat[0][1] = points[1].x; instance->mat[1][1] = points[1].y;
+            prim.reset(instance);
+            break;
+        }
+        default:
+            malformed();
+        }
+        prim->set_antialias(flags & FLAG_ANTIALIAS);
+        prim->set_stroke_width(stroke_width);
+        return prim;
+    }
+
+    std::string encode_snapshot(size_t width, size_t height,
+                                const PrimitiveMap& primitives, const ShapeMap& shapes) {
+        // Shapes that are no longer defined but still have instances are
+        // stored under fresh ids.
+        std::map<const Shape*, int> shape_ids;
+        std::vector<std::pair<int, const Shape*>> shape_list;
+        int next_id = shapes.empty() ? 0 : shapes.rbegin()->first + 1;
+        for (auto& ss : shapes)
+            if (shape_ids.emplace(ss.second.get(), ss.first).second)
+                shape_list.emplace_back(ss.first, ss.second.get());
+        for (auto& ps : primitives) {
+            if (ps.second->type() != Primitive::Type::Instance) continue;
+            const Shape *shape = static_cast<const Instance&>(*ps.second).shape.get();
+            if (shape_ids.emplace(shape, next_id).second)
+                shape_list.emplace_back(next_id++, shape);
+        }
+
+        std::string out(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        put_u32(out, SNAPSHOT_VERSION);
+        put_u32(out, width);
+        put_u32(out, height);
+        put_u32(out, primitives.size());
+        put_u32(out, shape_list.size());
+        for (auto& ss : shape_list)
+            encode_record(out, ss.first, ss.second->get_prototype(), shape_ids);
+        for (auto& ps : primitives)
+            encode_record(out, ps.first, *ps.second, shape_ids);
+        return out;
+    }
+
+    void decode_snapshot(const char *data, size_t size, size_t& width, size_t& height,
+                         PrimitiveMap& primitives, ShapeMap& shapes) {
+        if (size < HEADER_SIZE ||
+            std::memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+            malformed();
+        if (get_u32(data + 8) != SNAPSHOT_VERSION)
+            throw std::runtime_error("unsupported snapshot version");
+        size_t new_width = get_u32(data + 12), new_height = get_u32(data + 16);
+        uint32_t count = get_u32(data + 20), nshapes = get_u32(data + 24);
+        if (new_width > size_t(MAX_COORDINATE) || new_height > size_t(MAX_COORDINATE))
+            malformed();
+        const char *pos = data + HEADER_SIZE, *end = data + size;
+        ShapeMap new_shapes;
+        for (uint32_t i = 0; i < nshapes; i++) {
+            int id;
+            std::unique_ptr<Primitive> prim = decode_record(pos, end, new_shapes, id);
+            // the Shape constructor flattens the prototype, which takes points
+            size_t npoints;
+            switch (prim->type()) {
+            case Primitive::Type::Polygon:
+                npoints = static_cast<Polygon&>(*prim).points.size();
+                break;
+            case Primitive::Type::Bezier:
+                npoints = static_cast<Bezier&>(*prim).points.size();
+                break;
+            case Primitive::Type::BSpline:
+                npoints = static_cast<BSpline&>(*prim).points.size();
+                break;
+            default:
+                malformed();
+            }
+            if (npoints < 2) malformed();
+            if (!new_shapes.emplace(id, std::make_shared<const Shape>(prim.release())).second)
+                malformed();
+        }
+        PrimitiveMap result;
+        for (uint32_t i = 0; i < count; i++) {
+            int id;
+            std::unique_ptr<Primitive> prim = decode_record(pos, end, new_shapes, id);
+            if (!result.emplace(id, std::move(prim)).second)
+                malformed();
+        }
+        width = new_width;
+        height = new_height;
+        primitives = std::move(result);
+        shapes = std::move(new_shapes);
+    }
+
+    std::unique_ptr<Primitive> copy_primitive(const Primitive& prim) {
+        return prim.clone();
+    }
+
+    void save_snapshot(const std::string& filename, size_t width, size_t height,
+                       const PrimitiveMap& primitives, const ShapeMap& shapes) {
+        std::string data = encode_snapshot(width, height, primitives, shapes);
+        std::ofstream f(filename, std::ios::binary);
+        if (!f.write(data.data(), data.size()))
+            throw std::runtime_error("cannot save to '" + filename + "'");
+    }
+
+    void load_snapshot(const std::string& filename, size_t& width, size_t& height,
+                       PrimitiveMap& primitives, ShapeMap& shapes) {
+        std::ifstream f(filename, std::ios::binary | std::ios::ate);
+        if (!f.is_open())
+            throw std::runtime_error("cannot open '" + filename + "'");
+        std::vector<char> data(size_t(f.tellg()));
+        f.seekg(0);
+        if (!f.read(data.data(), data.size()))
+            throw std::runtime_error("cannot read '" + filename + "'");
+        decode_snapshot(data.data(), data.size(), width, height, primitives, shapes);
+    }
+}